@@ -0,0 +1,339 @@
+#include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/db_iterator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+    Runs reader threads (or processes) against one env while a single writer
+    commits at a fixed rate, for a sweep of env flags, reader limits and thread
+    counts. Reports read throughput, latency percentiles and the growth of the
+    data file during the run, then the growth over a second run of the writer
+    alone while a reader pins its snapshot for the whole run.
+
+    usage: lmdb-wrapper-bench-concurrency <dir> [seconds] [max threads] [commits/s] [processes]
+*/
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr size_t key_count = 100000;
+constexpr size_t max_samples = 100000;
+
+struct config {
+    std::string name;
+    std::vector<lmdb::env::flags> flags;
+    unsigned int max_readers;
+};
+
+struct reader_result {
+    size_t ops = 0;
+    std::vector<uint32_t> latency_ns;
+};
+
+lmdb::env open_env(const std::string& path, const config& cfg) {
+    lmdb::env::factory f;
+    f.set_map_size(size_t(1) << 32).set_max_readers(cfg.max_readers).set_max_dbs(4);
+    for (auto flag : cfg.flags) {
+        f.set(flag);
+    }
+    return f.open(path, 0644);
+}
+
+lmdb::dbi open_db(lmdb::txn_base& txn) {
+    return lmdb::dbi::factory(txn.handle()).set(lmdb::dbi::flags::create).open("bench");
+}
+
+lmdb::dbi populate(const lmdb::env& e) {
+    lmdb::write_txn txn(e.handle());
+    auto db = open_db(txn);
+    std::string value(64, 'x');
+    for (size_t i = 0; i < key_count; ++i) {
+        txn.put<std::string>(db, i, value, 0);
+    }
+    txn.commit();
+    return db;
+}
+
+size_t used_pages(const lmdb::env& e) {
+    MDB_envinfo info;
+    mdb_env_info(e.handle(), &info);
+    return info.me_last_pgno + 1;
+}
+
+reader_result run_reader(const lmdb::env& e, clock_type::time_point until, unsigned int seed) {
+    reader_result result;
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<size_t> dist(0, key_count - 1);
+    lmdb::dbi db;
+    {
+        // committing keeps the handle open after the txn
+        lmdb::read_txn txn(e.handle());
+        db = lmdb::dbi::factory(txn.handle()).open("bench");
+        txn.commit();
+    }
+    while (clock_type::now() < until) {
+        auto start = clock_type::now();
+        {
+            lmdb::read_txn txn(e.handle());
+            if (result.ops % 16) {
+                txn.get<std::string>(db, dist(rng));
+            } else {
+                lmdb::db_iterator<size_t, std::string> it(txn, {db});
+                it.seek_range(dist(rng));
+                for (int i = 0; i < 100 && it != lmdb::db_iterator<size_t, std::string>(); ++i) {
+                    ++it;
+                }
+            }
+        }
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+        if (result.latency_ns.size() < max_samples) {
+            result.latency_ns.push_back(static_cast<uint32_t>(std::min<long long>(ns, UINT32_MAX)));
+        } else {
+            // reservoir sampling keeps the percentiles unbiased over long runs
+            std::uniform_int_distribution<size_t> slot(0, result.ops);
+            size_t i = slot(rng);
+            if (i < max_samples) {
+                result.latency_ns[i] = static_cast<uint32_t>(std::min<long long>(ns, UINT32_MAX));
+            }
+        }
+        ++result.ops;
+    }
+    return result;
+}
+
+void run_writer(const lmdb::env& e, lmdb::dbi db, clock_type::time_point until, unsigned int rate, std::atomic<size_t>& commits) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<size_t> dist(0, key_count - 1);
+    std::string value(64, 'y');
+    auto interval = std::chrono::nanoseconds(1000000000ull / std::max(rate, 1u));
+    auto next = clock_type::now();
+    while (clock_type::now() < until) {
+        lmdb::write_txn txn(e.handle());
+        for (int i = 0; i < 8; ++i) {
+            txn.put<std::string>(db, dist(rng), value, 0);
+        }
+        txn.commit();
+        ++commits;
+        next += interval;
+        std::this_thread::sleep_until(next);
+    }
+}
+
+#ifndef _WIN32
+struct process_reader {
+    pid_t pid;
+    int start_fd;
+    int result_fd;
+};
+
+/**
+    Forks the reader processes, before the parent starts any thread; each one
+    opens the env again and waits for the end of the run to be sent.
+*/
+std::vector<process_reader> fork_readers(const std::string& path, const config& cfg, unsigned int count) {
+    std::vector<process_reader> children;
+    for (unsigned int i = 0; i < count; ++i) {
+        int start[2], result[2];
+        if (pipe(start)) {
+            throw std::runtime_error("pipe failed");
+        }
+        if (pipe(result)) {
+            close(start[0]);
+            close(start[1]);
+            throw std::runtime_error("pipe failed");
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(start[1]);
+            close(result[0]);
+            for (const auto& c : children) {
+                close(c.start_fd);
+                close(c.result_fd);
+            }
+            // the env must be opened again after fork
+            auto e = open_env(path, cfg);
+            clock_type::rep until;
+            if (read(start[0], &until, sizeof(until)) != sizeof(until)) {
+                _exit(1);
+            }
+            auto r = run_reader(e, clock_type::time_point(clock_type::duration(until)), i + 1);
+            size_t header[2] = {r.ops, r.latency_ns.size()};
+            ssize_t ok = write(result[1], header, sizeof(header));
+            ok = ok > 0? write(result[1], r.latency_ns.data(), r.latency_ns.size() * sizeof(uint32_t)) : ok;
+            _exit(ok < 0);
+        }
+        close(start[0]);
+        close(result[1]);
+        children.push_back({pid, start[1], result[0]});
+    }
+    return children;
+}
+
+void start_readers(const std::vector<process_reader>& children, clock_type::time_point until) {
+    // the steady clock is shared by the processes of a machine
+    clock_type::rep ticks = until.time_since_epoch().count();
+    for (const auto& c : children) {
+        if (write(c.start_fd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+            throw std::runtime_error("failed to start reader process");
+        }
+        close(c.start_fd);
+    }
+}
+
+reader_result collect_readers(const std::vector<process_reader>& children) {
+    reader_result total;
+    for (const auto& c : children) {
+        int fd = c.result_fd;
+        size_t header[2] = {0, 0};
+        if (read(fd, header, sizeof(header)) == sizeof(header)) {
+            total.ops += header[0];
+            size_t offset = total.latency_ns.size();
+            total.latency_ns.resize(offset + header[1]);
+            auto ptr = reinterpret_cast<char*>(total.latency_ns.data() + offset);
+            size_t left = header[1] * sizeof(uint32_t);
+            while (left) {
+                ssize_t n = read(fd, ptr, left);
+                if (n <= 0) {
+                    break;
+                }
+                ptr += n;
+                left -= n;
+            }
+        }
+        close(fd);
+        waitpid(c.pid, nullptr, 0);
+    }
+    return total;
+}
+#endif
+
+double percentile(std::vector<uint32_t>& samples, double p) {
+    if (samples.empty()) {
+        return 0;
+    }
+    size_t i = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+    return samples[i] / 1000.0;
+}
+
+void run(const std::string& dir, const config& cfg, unsigned int threads, bool processes, double seconds, unsigned int rate) {
+    std::string path = dir + "/" + cfg.name + "-" + std::to_string(cfg.max_readers) + "-" + std::to_string(threads);
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+
+    auto e = open_env(path, cfg);
+    auto db = populate(e);
+
+#ifndef _WIN32
+    std::vector<process_reader> children;
+    if (processes) {
+        children = fork_readers(path, cfg, threads);
+    }
+#endif
+
+    size_t pages_before = used_pages(e);
+    auto duration = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(seconds));
+    auto until = clock_type::now() + duration;
+    std::atomic<size_t> commits{0};
+    std::thread writer(run_writer, std::cref(e), db, until, rate, std::ref(commits));
+
+    reader_result total;
+#ifndef _WIN32
+    if (processes) {
+        start_readers(children, until);
+        total = collect_readers(children);
+    } else
+#endif
+    {
+        std::vector<reader_result> results(threads);
+        std::vector<std::thread> readers;
+        for (unsigned int i = 0; i < threads; ++i) {
+            readers.emplace_back([&, i] {
+                results[i] = run_reader(e, until, i + 1);
+            });
+        }
+        for (auto& t : readers) {
+            t.join();
+        }
+        for (auto& r : results) {
+            total.ops += r.ops;
+            total.latency_ns.insert(total.latency_ns.end(), r.latency_ns.begin(), r.latency_ns.end());
+        }
+    }
+    writer.join();
+    size_t growth = used_pages(e) - pages_before;
+
+    // the writer alone again, while a snapshot taken before it started is
+    // held to the end, so the pages it frees cannot be reused
+    pages_before = used_pages(e);
+    until = clock_type::now() + duration;
+    size_t pinned_commits;
+    {
+        lmdb::read_txn pinned(e.handle());
+        std::atomic<size_t> count{0};
+        std::thread pinned_writer(run_writer, std::cref(e), db, until, rate, std::ref(count));
+        pinned_writer.join();
+        pinned_commits = count;
+    }
+    size_t pinned_growth = used_pages(e) - pages_before;
+
+    std::printf("%-16s readers=%-5u %s=%-3u ops/s=%-10.0f p50_us=%-8.2f p99_us=%-8.2f p999_us=%-8.2f commits=%-6zu growth_pages=%-8zu pinned_commits=%-6zu pinned_growth_pages=%zu\n",
+        cfg.name.c_str(), cfg.max_readers, processes? "procs" : "threads", threads,
+        total.ops / seconds,
+        percentile(total.latency_ns, 0.5), percentile(total.latency_ns, 0.99), percentile(total.latency_ns, 0.999),
+        commits.load(), growth, pinned_commits, pinned_growth);
+    std::fflush(stdout);
+
+    std::filesystem::remove_all(path);
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: %s <dir> [seconds] [max threads] [commits/s] [processes]\n", argv[0]);
+        return 1;
+    }
+    std::string dir = argv[1];
+    double seconds = argc > 2? std::atof(argv[2]) : 5.0;
+    unsigned int max_threads = argc > 3? std::atoi(argv[3]) : std::thread::hardware_concurrency();
+    unsigned int rate = argc > 4? std::atoi(argv[4]) : 100;
+    bool processes = argc > 5 && std::string(argv[5]) == "processes";
+
+    using flags = lmdb::env::flags;
+    std::vector<config> configs;
+    for (unsigned int readers : {126u, 1024u}) {
+        configs.push_back({"default", {}, readers});
+        configs.push_back({"notls", {flags::notls}, readers});
+        configs.push_back({"nosync", {flags::nosync}, readers});
+        configs.push_back({"writemap", {flags::writemap}, readers});
+        configs.push_back({"writemap+mapasync", {flags::writemap, flags::mapasync}, readers});
+    }
+
+    try {
+        for (const auto& cfg : configs) {
+            for (unsigned int threads = 1; threads <= std::max(max_threads, 1u); threads *= 2) {
+                run(dir, cfg, threads, processes, seconds, rate);
+            }
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "error: %s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
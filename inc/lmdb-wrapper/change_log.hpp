@@ -0,0 +1,136 @@
+#pragma once
+
+#include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/txn.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    A single logged mutation.
+*/
+struct change {
+    enum class op : unsigned char {
+        put = 1,
+        del = 2
+    };
+
+    /**
+        Position of a record in the log, ordered by transaction then by
+        sequence within the transaction.
+    */
+    struct position {
+        uint64_t txnid = 0;
+        uint32_t seq = 0;
+    };
+
+    position pos;
+    op kind;
+    /**
+        Name of the changed database, empty for the main database.
+    */
+    std::string db;
+    std::chrono::system_clock::time_point time;
+    std::string key;
+};
+
+/**
+    Log of the mutations made by write transactions with log_changes enabled.
+    Records are stored in a dedicated database of the environment, keyed by
+    (txnid, seq) in big endian order, and written in the same transaction as
+    the change they describe. Databases are recorded by name, so the log can
+    be read by another process or after a restart, which requires an
+    environment opened through env::factory. Committing wakes the readers
+    blocked in change_reader::wait, in this process and, on Linux, in other
+    processes through a futex on a counter file next to the data file.
+*/
+class change_log {
+public:
+    struct retention {
+        size_t max_entries = 0;
+        std::chrono::milliseconds max_age{0};
+    };
+
+    change_log(const env& e, const std::string& name = "__changes");
+    ~change_log();
+
+    change_log(const change_log&) = delete;
+    change_log& operator=(const change_log&) = delete;
+
+    const dbi& db() const;
+
+    MDB_env* env_handle() const;
+
+    void append(MDB_txn* txn, uint32_t seq, change::op kind, const dbi& db, const MDB_val& key);
+
+    /**
+        Wakes the readers waiting for new records.
+    */
+    void notify();
+
+    /**
+        Counter incremented by every notify, sampled before reading so that no wakeup is missed.
+    */
+    uint32_t sequence() const;
+
+    /**
+        Blocks until the counter moves past seen or the timeout expires.
+        @return false on timeout
+    */
+    bool wait(uint32_t seen, std::chrono::milliseconds timeout) const;
+
+    /**
+        Deletes the oldest records beyond the entry count or age limits, a zero limit is ignored.
+        @return number of deleted records
+    */
+    size_t trim(write_txn& txn, const retention& policy) const;
+
+    /**
+        Deletes the records before the given position, e.g. the slowest consumer.
+    */
+    size_t trim(write_txn& txn, const change::position& before) const;
+
+private:
+    env env_;
+    dbi db_;
+    std::atomic<uint32_t> *counter_;
+    std::atomic<uint32_t> local_counter_;
+    mutable std::mutex mutex_;
+    mutable std::condition_variable cv_;
+};
+
+/**
+    Tails a change log from a saved position. The position is that of the
+    next record to read and can be persisted to resume after a restart.
+*/
+class change_reader {
+public:
+    change_reader(const change_log& log, change::position from = change::position());
+
+    /**
+        Returns up to max records without blocking.
+    */
+    std::vector<change> poll(size_t max);
+
+    /**
+        Returns up to max records, blocking until at least one is available or the timeout expires.
+    */
+    std::vector<change> wait(size_t max, std::chrono::milliseconds timeout);
+
+    change::position position() const;
+
+    void seek(const change::position& pos);
+
+private:
+    const change_log *log_;
+    change::position pos_;
+};
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <lmdb.h>
+#include <algorithm>
+#include <cstring>
+
+namespace lmdb {
+
+/**
+    Byte order of two strings, a proper prefix first.
+    @return -1, 0 or 1, so that columns can negate it
+*/
+inline int compare_bytes(const unsigned char* a, size_t a_size, const unsigned char* b, size_t b_size) {
+    int result = std::memcmp(a, b, std::min(a_size, b_size));
+    if (!result) {
+        result = (a_size > b_size) - (a_size < b_size);
+    }
+    return (result > 0) - (result < 0);
+}
+
+/**
+    Unsigned big endian field of Width bytes.
+*/
+template <size_t Width>
+struct big_endian {
+    static int compare(const unsigned char*& a, const unsigned char* a_end, const unsigned char*& b, const unsigned char* b_end) {
+        size_t a_size = std::min<size_t>(Width, a_end - a);
+        size_t b_size = std::min<size_t>(Width, b_end - b);
+        int result = compare_bytes(a, a_size, b, b_size);
+        a += a_size;
+        b += b_size;
+        return result;
+    }
+};
+
+/**
+    String preceded by its length as a LengthWidth byte big endian integer.
+*/
+template <size_t LengthWidth>
+struct length_prefixed {
+    static int compare(const unsigned char*& a, const unsigned char* a_end, const unsigned char*& b, const unsigned char* b_end) {
+        size_t a_size = read_length(a, a_end);
+        size_t b_size = read_length(b, b_end);
+        int result = compare_bytes(a, a_size, b, b_size);
+        a += a_size;
+        b += b_size;
+        return result;
+    }
+
+private:
+    static size_t read_length(const unsigned char*& p, const unsigned char* end) {
+        size_t length = 0;
+        for (size_t i = 0; i < LengthWidth && p != end; ++i, ++p) {
+            length = (length << 8) | *p;
+        }
+        return std::min<size_t>(length, end - p);
+    }
+};
+
+/**
+    Reverses the order of a column.
+*/
+template <class Column>
+struct descending {
+    static int compare(const unsigned char*& a, const unsigned char* a_end, const unsigned char*& b, const unsigned char* b_end) {
+        return -Column::compare(a, a_end, b, b_end);
+    }
+};
+
+/**
+    Key layout for mdb_set_compare/mdb_set_dupsort. A key is described as a
+    composite of columns, each column compares its part of both keys and
+    advances past it, e.g.
+
+        composite<big_endian<4>, descending<big_endian<8>>, length_prefixed<2>>
+
+    orders by a 4 byte id, then newest timestamp first, then by name. The
+    columns are compared in order, bytes past the last column compare as raw
+    bytes. Register with dbi::factory::set_compare<...>() or set_dupsort<...>().
+*/
+template <class... Columns>
+struct composite {
+    static int compare(const MDB_val* a, const MDB_val* b) {
+        auto pa = static_cast<const unsigned char*>(a->mv_data);
+        auto pb = static_cast<const unsigned char*>(b->mv_data);
+        auto a_end = pa + a->mv_size;
+        auto b_end = pb + b->mv_size;
+        int result = 0;
+        ((result || (result = Columns::compare(pa, a_end, pb, b_end))), ...);
+        if (!result) {
+            result = compare_bytes(pa, a_end - pa, pb, b_end - pb);
+        }
+        return result;
+    }
+};
+
+}
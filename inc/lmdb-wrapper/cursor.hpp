@@ -1,6 +1,9 @@
 #pragma once
 
 #include "lmdb-wrapper/value.hpp"
+#include "lmdb-wrapper/key_range.hpp"
+#include "lmdb-wrapper/trace.hpp"
+#include <memory_resource>
 #include <optional>
 
 namespace lmdb {
@@ -8,16 +11,23 @@ namespace lmdb {
 template <class K, class T>
 class cursor {
 public:
-    cursor(): cursor_{nullptr} {
+    cursor(): cursor_{nullptr}, resource_{std::pmr::get_default_resource()} {
 
     }
 
-    cursor(MDB_txn* t, MDB_dbi d): cursor() {
+    /**
+        @param resource memory resource used when decoding keys and values
+    */
+    cursor(MDB_txn* t, MDB_dbi d, std::pmr::memory_resource* resource = std::pmr::get_default_resource()): cursor() {
+        resource_ = resource;
         if (mdb_cursor_open(t, d, &cursor_)) {
             throw std::runtime_error("failed to open cursor");
         }
         MDB_val key, data;
-        if (mdb_cursor_get(cursor_, &key, &data, MDB_FIRST)) {
+        trace_scope trace(trace_recorder::op::cursor_get, d, MDB_FIRST);
+        int err = mdb_cursor_get(cursor_, &key, &data, MDB_FIRST);
+        trace.done(err, err? nullptr : &key, err? 0 : data.mv_size);
+        if (err) {
             throw std::runtime_error("cursor error");
         }
     }
@@ -29,7 +39,7 @@ public:
         }
     }
 
-    cursor(const cursor& other): cursor_{nullptr} {
+    cursor(const cursor& other): cursor_{nullptr}, resource_{other.resource_} {
         if (other.cursor_) {
             MDB_val other_key, other_data;
             if (!mdb_cursor_get(other.cursor_, &other_key, &other_data, MDB_GET_CURRENT)) {
@@ -70,6 +80,7 @@ public:
             mdb_cursor_close(cursor_);
             cursor_ = nullptr;
         }
+        resource_ = other.resource_;
         if (other.cursor_) {
             MDB_val other_key, other_data;
             if (!mdb_cursor_get(other.cursor_, &other_key, &other_data, MDB_GET_CURRENT)) {
@@ -91,9 +102,10 @@ public:
                 }
             }
         }
+        return *this;
     }
 
-    cursor(cursor&& other):cursor_{other.cursor_} {
+    cursor(cursor&& other):cursor_{other.cursor_}, resource_{other.resource_} {
         other.cursor_ = nullptr;
     }
 
@@ -102,10 +114,19 @@ public:
             mdb_cursor_close(cursor_);
         }
         cursor_ = other.cursor_;
+        resource_ = other.resource_;
         other.cursor_ = nullptr;
         return *this;
     }
 
+    std::pmr::memory_resource* resource() const {
+        return resource_;
+    }
+
+    void set_resource(std::pmr::memory_resource* resource) {
+        resource_ = resource;
+    }
+
     /**
         @param op one of the following op codes
         MDB_FIRST, MDB_FIRST_DUP, MDB_GET_BOTH, MDB_GET_BOTH_RANGE,
@@ -120,10 +141,51 @@ public:
             return result;
         }
         MDB_val key, data;
+        trace_scope trace(trace_recorder::op::cursor_get, dbi(), op);
         int err = mdb_cursor_get(cursor_, &key, &data, op);
+        trace.done(err, err? nullptr : &key, err? 0 : data.mv_size);
+        if (!err) {
+            result = decode(key, data);
+        }
+        return result;
+    }
+
+    /**
+        Positions at the first entry of the range in its scan order.
+        @return nothing if the range is empty
+    */
+    std::optional<std::pair<K, T>> seek(const key_range& range) const {
+        std::optional<std::pair<K, T>> result;
+        if (!cursor_) {
+            return result;
+        }
+        MDB_val key, data;
+        // replayed as a lookup of the entry it lands on
+        trace_scope trace(trace_recorder::op::cursor_get, dbi(), MDB_SET_RANGE);
+        int err = range.first(cursor_, key, data);
+        trace.done(err, err? nullptr : &key, err? 0 : data.mv_size);
         if (!err) {
-            object<T> obj(data);
-            result = std::make_pair(value::unpack<K>(key), obj.value());
+            result = decode(key, data);
+        }
+        return result;
+    }
+
+    /**
+        Moves to the next entry of the range in its scan order, entries past
+        the bound are not decoded.
+        @return nothing at the end of the range
+    */
+    std::optional<std::pair<K, T>> next(const key_range& range) const {
+        std::optional<std::pair<K, T>> result;
+        if (!cursor_) {
+            return result;
+        }
+        MDB_val key, data;
+        trace_scope trace(trace_recorder::op::cursor_get, dbi(), range.is_reverse()? MDB_PREV : MDB_NEXT);
+        int err = range.next(cursor_, key, data);
+        trace.done(err, err? nullptr : &key, err? 0 : data.mv_size);
+        if (!err) {
+            result = decode(key, data);
         }
         return result;
     }
@@ -134,15 +196,27 @@ public:
             return result;
         }
         MDB_val mdb_key = value::pack<K>(key);
+        MDB_val input = mdb_key;
         object<T> obj(value);
-        if (!mdb_cursor_get(cursor_, &mdb_key, obj.data(), op)) {
-            result = std::make_pair(value::unpack<K>(mdb_key), obj.value());
+        trace_scope trace(trace_recorder::op::cursor_get, dbi(), op);
+        int err = mdb_cursor_get(cursor_, &mdb_key, obj.data(), op);
+        trace.done(err, &input, err? 0 : obj.data()->mv_size);
+        if (!err) {
+            object<K> k(mdb_key);
+            result = std::make_pair(k.value(resource_), obj.value(resource_));
         }
         return result;
     }
 
 private:
+    std::pair<K, T> decode(const MDB_val& key, const MDB_val& data) const {
+        object<K> k(key);
+        object<T> obj(data);
+        return std::make_pair(k.value(resource_), obj.value(resource_));
+    }
+
     MDB_cursor *cursor_;
+    std::pmr::memory_resource *resource_;
 };
 
 }
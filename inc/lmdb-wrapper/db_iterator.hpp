@@ -2,6 +2,7 @@
 
 #include "lmdb-wrapper/env.hpp"
 #include <memory>
+#include <memory_resource>
 #include <vector>
 #include <numeric>
 #include <algorithm>
@@ -13,17 +14,37 @@ class db_iterator {
     
     std::vector<cursor<K, V>> cursors_;
     std::vector<std::optional<std::pair<K, V>>> kv_;
+    key_range range_;
     size_t next_;
 
 public:
     db_iterator() = default;
 
-    db_iterator(const txn_base& txn, const std::vector<dbi>& dbis);
+    /**
+        @param resource memory resource used when decoding keys and values,
+        e.g. a request scoped std::pmr::monotonic_buffer_resource
+    */
+    db_iterator(const txn_base& txn, const std::vector<dbi>& dbis, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+        Merges only the entries of each database within the range, in its scan order.
+    */
+    db_iterator(const txn_base& txn, const std::vector<dbi>& dbis, const key_range& range, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /**
+        Merges databases read by different transactions, e.g. of different
+        environments, txns[i] reads dbis[i]. The transactions must outlive the iterator.
+    */
+    db_iterator(const std::vector<MDB_txn*>& txns, const std::vector<dbi>& dbis, const key_range& range, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     db_iterator(const db_iterator&) = default;
     
     db_iterator& operator=(const db_iterator&) = default;
 
+    db_iterator(db_iterator&&) = default;
+
+    db_iterator& operator=(db_iterator&&) = default;
+
     ~db_iterator() = default;
 
     const std::pair<K, V>& operator*() const;
@@ -42,18 +63,94 @@ public:
 
     db_iterator& seek_both(const K& key, const V& value);
 
+    /**
+        Restarts the iteration over the given range.
+    */
+    db_iterator& seek(const key_range& range);
+
 private:
     void update_next();
 
 };
 
 
+/**
+    Adapts an iterator that owns its position, like db_iterator, for range-for:
+
+        for (const auto& [key, value] : range(db_iterator<K, V>(txn, dbis, key_range::prefix(p)))) {}
+*/
+template <class It>
+class iterator_range {
+public:
+    class sentinel {
+    };
+
+    class iterator {
+    public:
+        iterator(It* it):it_{it} {
+        }
+
+        decltype(auto) operator*() const {
+            return **it_;
+        }
+
+        iterator& operator++() {
+            ++*it_;
+            return *this;
+        }
+
+        bool operator!=(const sentinel&) const {
+            return *it_ != It();
+        }
+
+        bool operator==(const sentinel& s) const {
+            return !(*this != s);
+        }
+
+    private:
+        It *it_;
+    };
+
+    iterator_range(It it):it_{std::move(it)} {
+    }
+
+    iterator begin() {
+        return iterator(&it_);
+    }
+
+    sentinel end() const {
+        return sentinel();
+    }
+
+private:
+    It it_;
+};
+
+template <class It>
+iterator_range<It> range(It it) {
+    return iterator_range<It>(std::move(it));
+}
+
+
 template <class K, class V>
-db_iterator<K, V>::db_iterator(const txn_base& txn, const std::vector<dbi>& dbis) {
+db_iterator<K, V>::db_iterator(const txn_base& txn, const std::vector<dbi>& dbis, std::pmr::memory_resource* resource):
+    db_iterator(txn, dbis, key_range::all(), resource) {
 
-    for (const auto& dbi : dbis) {
+}
+
+template <class K, class V>
+db_iterator<K, V>::db_iterator(const txn_base& txn, const std::vector<dbi>& dbis, const key_range& range, std::pmr::memory_resource* resource):
+    db_iterator(std::vector<MDB_txn*>(dbis.size(), txn.handle()), dbis, range, resource) {
+
+}
+
+template <class K, class V>
+db_iterator<K, V>::db_iterator(const std::vector<MDB_txn*>& txns, const std::vector<dbi>& dbis, const key_range& range, std::pmr::memory_resource* resource):
+    range_{range} {
+
+    for (size_t i = 0; i < dbis.size(); ++i) {
         try {
-            cursors_.emplace_back(txn.handle(), dbi.handle());
+            cursors_.emplace_back(txns[i], dbis[i].handle(), resource);
         } catch (const std::runtime_error&) {
             cursors_.emplace_back(); // create an empty cursor for this db
         }
@@ -61,7 +158,7 @@ db_iterator<K, V>::db_iterator(const txn_base& txn, const std::vector<dbi>& dbis
 
     if (!cursors_.empty()) {
         for (auto& cur : cursors_) {
-            kv_.push_back(cur.get(MDB_FIRST));
+            kv_.push_back(cur.seek(range_));
         }
         update_next();
     }
@@ -88,7 +185,7 @@ db_iterator<K, V>& db_iterator<K, V>::operator++() {
     if (kv_.empty() || !kv_[next_]) {
         return *this;
     }
-    kv_[next_] = cursors_[next_].get(MDB_NEXT);
+    kv_[next_] = cursors_[next_].next(range_);
     update_next();
     return *this;
 }
@@ -116,17 +213,21 @@ size_t db_iterator<K, V>::dbi_index() const {
 
 template <class K, class V>
 db_iterator<K, V>& db_iterator<K, V>::seek_range(const K& key) {
-    
+    return seek(key_range::from(key));
+}
+
+template <class K, class V>
+db_iterator<K, V>& db_iterator<K, V>::seek_both(const K& key, const V& value) {
+    range_ = key_range::all();
     kv_.clear();
     if (cursors_.empty()) {
         throw std::runtime_error("invalid iterator");
     }
 
-    V dummy;
     for (auto& cur : cursors_) {
-        auto data = cur.get(key, dummy, MDB_SET_RANGE);
+        auto data = cur.get(key, value, MDB_GET_BOTH);
         if (data) {
-            kv_.push_back(cur.get(MDB_GET_CURRENT));
+            kv_.push_back(data);
         } else {
             kv_.emplace_back();
         }
@@ -136,19 +237,15 @@ db_iterator<K, V>& db_iterator<K, V>::seek_range(const K& key) {
 }
 
 template <class K, class V>
-db_iterator<K, V>& db_iterator<K, V>::seek_both(const K& key, const V& value) {
+db_iterator<K, V>& db_iterator<K, V>::seek(const key_range& range) {
     kv_.clear();
     if (cursors_.empty()) {
         throw std::runtime_error("invalid iterator");
     }
 
+    range_ = range;
     for (auto& cur : cursors_) {
-        auto data = cur.get(key, value, MDB_GET_BOTH);
-        if (data) {
-            kv_.push_back(data);
-        } else {
-            kv_.emplace_back();
-        }
+        kv_.push_back(cur.seek(range_));
     }
     update_next();
     return *this;
@@ -160,7 +257,10 @@ void db_iterator<K, V>::update_next() {
     std::iota(indices.begin(), indices.end(), 0);
     auto next = std::min_element(indices.begin(), indices.end(), [&](size_t x, size_t y) -> bool {
         if (kv_[x] && kv_[y]) {
-            return kv_[x]->first < kv_[y]->first;
+            // order as the database does, including custom comparators
+            MDB_val a = value::pack(kv_[x]->first), b = value::pack(kv_[y]->first);
+            int cmp = mdb_cmp(cursors_[x].txn(), cursors_[x].dbi(), &a, &b);
+            return range_.is_reverse()? cmp > 0 : cmp < 0;
         }
         return bool(kv_[x]);
     });
@@ -2,6 +2,8 @@
 
 #include "lmdb-wrapper/value.hpp"
 #include "lmdb-wrapper/cursor.hpp"
+#include "lmdb-wrapper/comparator.hpp"
+#include "lmdb-wrapper/trace.hpp"
 
 #include <stdexcept>
 
@@ -25,6 +27,8 @@ public:
     };
 
     dbi() = default;
+
+    explicit dbi(MDB_dbi handle);
     
     dbi(MDB_txn*, unsigned int);
 
@@ -52,12 +56,49 @@ public:
     template <class T>
     void put(MDB_txn* txn, const size_t& key, const T& val, unsigned int flags) const;
 
+    template <class T>
+    bool del(MDB_txn* txn, const std::string& key, const T& val) const;
+
+    bool del(MDB_txn* txn, const std::string& key) const;
+
+    template <class T>
+    bool del(MDB_txn* txn, const size_t& key, const T& val) const;
+
+    bool del(MDB_txn* txn, const size_t& key) const;
+
     template <class K, class T>
-    cursor<K, T> open_cursor(MDB_txn* t);
+    cursor<K, T> open_cursor(MDB_txn* t, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     MDB_dbi handle() const;
 
+    /**
+        Installs a key comparison function, must be called before any data
+        access and every time the database is opened.
+    */
+    void set_compare(MDB_txn* txn, MDB_cmp_func* cmp) const;
+
+    void set_dupsort(MDB_txn* txn, MDB_cmp_func* cmp) const;
+
+    /**
+        Compares two packed keys with the ordering of this database.
+    */
+    int compare(MDB_txn* txn, const MDB_val& a, const MDB_val& b) const;
+
+    /**
+        Keep the key filter of the database, if one is enabled, in step with
+        a put or del made with the LMDB functions directly. Puts that skip
+        filter_put make gets of their keys fail.
+    */
+    static void filter_put(MDB_txn* txn, MDB_dbi dbi, const MDB_val& key);
+
+    static void filter_del(MDB_txn* txn, MDB_dbi dbi);
+
 private:
+    /**
+        Consults the key filter of the database, if one is enabled.
+        @return false if the key certainly does not exist
+    */
+    static bool may_contain(MDB_txn* txn, MDB_dbi dbi, const MDB_val& key);
 
     MDB_dbi dbi_;
 };
@@ -68,11 +109,35 @@ public:
     factory& set(flags);
     factory& unset(flags);
     factory& unset_flags();
+
+    /**
+        Comparators installed on every database this factory opens, see comparator.hpp.
+    */
+    factory& set_compare(MDB_cmp_func*);
+    factory& set_dupsort(MDB_cmp_func*);
+
+    template <class Compare>
+    factory& set_compare() {
+        return set_compare(&Compare::compare);
+    }
+
+    template <class Compare>
+    factory& set_dupsort() {
+        return set_dupsort(&Compare::compare);
+    }
+
+    /**
+        Named databases are opened through the registry of the environment, when it has one.
+    */
     dbi open(const std::string& name);
     dbi open();
 private:
+    dbi init(dbi);
+
     MDB_txn *txn_;
     unsigned int flags_;
+    MDB_cmp_func *compare_;
+    MDB_cmp_func *dupsort_;
 };
 
 template <class Key>
@@ -83,8 +148,10 @@ public:
     template <class T>
     static T get(MDB_txn *txn, MDB_dbi dbi, const key_t& key) {
         MDB_val k = value::pack(key);
-        MDB_val result;
-        auto err = mdb_get(txn, dbi, &k, &result);
+        MDB_val result{0, nullptr};
+        trace_scope trace(trace_recorder::op::get, dbi);
+        auto err = may_contain(txn, dbi, k)? mdb_get(txn, dbi, &k, &result) : MDB_NOTFOUND;
+        trace.done(err, &k, result.mv_size);
         object<T> obj(result);
         switch (err) {
             case 0:
@@ -99,8 +166,10 @@ public:
     template <class T>
     static T get(MDB_txn *txn, MDB_dbi dbi, const key_t& key, const T& default_value) {
         MDB_val k = value::pack(key);
-        MDB_val result;
-        auto err = mdb_get(txn, dbi, &k, &result);
+        MDB_val result{0, nullptr};
+        trace_scope trace(trace_recorder::op::get, dbi);
+        auto err = may_contain(txn, dbi, k)? mdb_get(txn, dbi, &k, &result) : MDB_NOTFOUND;
+        trace.done(err, &k, result.mv_size);
         object<T> obj(result);
         switch (err) {
             case 0:
@@ -116,9 +185,12 @@ public:
     static void put(MDB_txn *txn, MDB_dbi dbi, const key_t& key, const T& value, unsigned int flags) {
         MDB_val k = value::pack(key);
         object<T> obj(value);
+        trace_scope trace(trace_recorder::op::put, dbi, flags);
         auto err = mdb_put(txn, dbi, &k, obj.data(), flags);
+        trace.done(err, &k, obj.data()->mv_size);
         switch (err) {
             case 0:
+                filter_put(txn, dbi, k);
                 break;
             case MDB_MAP_FULL: 
                 throw std::runtime_error("db is full");
@@ -130,6 +202,34 @@ public:
                 throw std::runtime_error("failed to put value");
         }
     }
+
+    /**
+        Deletes the key, or only the given duplicate of it when data is not null.
+        @return false if the key/data pair did not exist
+    */
+    static bool del(MDB_txn *txn, MDB_dbi dbi, const key_t& key, MDB_val* data) {
+        MDB_val k = value::pack(key);
+        trace_scope trace(trace_recorder::op::del, dbi);
+        auto err = mdb_del(txn, dbi, &k, data);
+        trace.done(err, &k, data? data->mv_size : 0);
+        switch (err) {
+            case 0:
+                filter_del(txn, dbi);
+                return true;
+            case MDB_NOTFOUND:
+                return false;
+            case EACCES:
+                throw std::runtime_error("read only txn");
+            default:
+                throw std::runtime_error("failed to delete value");
+        }
+    }
+
+    template <class T>
+    static bool del(MDB_txn *txn, MDB_dbi dbi, const key_t& key, const T& value) {
+        object<T> obj(value);
+        return del(txn, dbi, key, obj.data());
+    }
 };
 
 template <class T>
@@ -162,9 +262,27 @@ inline void dbi::put(MDB_txn* txn, const size_t& key, const T& val, unsigned int
     dbi::store<size_t>::template put<T>(txn, dbi_, key, val, flags);
 }
 
+template <class T>
+inline bool dbi::del(MDB_txn* txn, const std::string& key, const T& val) const {
+    return dbi::store<std::string>::template del<T>(txn, dbi_, key, val);
+}
+
+inline bool dbi::del(MDB_txn* txn, const std::string& key) const {
+    return dbi::store<std::string>::del(txn, dbi_, key, nullptr);
+}
+
+template <class T>
+inline bool dbi::del(MDB_txn* txn, const size_t& key, const T& val) const {
+    return dbi::store<size_t>::template del<T>(txn, dbi_, key, val);
+}
+
+inline bool dbi::del(MDB_txn* txn, const size_t& key) const {
+    return dbi::store<size_t>::del(txn, dbi_, key, nullptr);
+}
+
 template <class K, class T>
-inline cursor<K, T> dbi::open_cursor(MDB_txn* t) {
-    return std::move(cursor<K, T>(t, dbi_));
+inline cursor<K, T> dbi::open_cursor(MDB_txn* t, std::pmr::memory_resource* resource) {
+    return std::move(cursor<K, T>(t, dbi_, resource));
 }
 
 }
@@ -0,0 +1,173 @@
+#pragma once
+
+#include "lmdb-wrapper/dbi.hpp"
+#include "lmdb-wrapper/key_filter.hpp"
+
+#include <lmdb.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+namespace lmdb {
+
+/**
+    Named database handles of an environment, opened once and shared by all
+    transactions. Lookups read an immutable snapshot without locking; misses
+    open the database in a dedicated transaction on a helper thread, so they
+    do not interfere with the reader slot or write lock of the caller, and
+    publish a new snapshot. A database found missing is not looked up again
+    until another transaction commits.
+
+    LMDB only lets a transaction use the handles opened before it began, so
+    the named databases that exist when the environment is opened are all
+    registered right away, see preload.
+
+    Every environment opened through env::factory owns one, reachable with
+    env::dbis() and used by dbi::factory::open(name).
+*/
+class dbi_registry {
+public:
+    struct entry {
+        dbi db;
+        unsigned int flags;
+        MDB_cmp_func *compare;
+        MDB_cmp_func *dupsort;
+    };
+
+    dbi_registry(MDB_env* env);
+
+    /**
+        Stops filter rebuilds and saves the persistent filters.
+    */
+    ~dbi_registry();
+
+    dbi_registry(const dbi_registry&) = delete;
+    dbi_registry& operator=(const dbi_registry&) = delete;
+
+    /**
+        @return the registry of an environment opened through env::factory, or null
+    */
+    static dbi_registry* of(MDB_env* env);
+
+    std::optional<entry> find(const std::string& name) const;
+
+    /**
+        @return the name a handle was opened with in this process, empty for
+            the main database, or nothing if it was not opened through the
+            registry or dbi
+    */
+    std::optional<std::string> name(MDB_dbi db) const;
+
+    /**
+        Remembers the name of a handle, called by every open.
+    */
+    void named(MDB_dbi db, const std::string& name);
+
+    /**
+        Opens every named database of the environment, scanning the main
+        database once. Called by env::factory::open before any transaction
+        can begin, stops quietly when the maximum number of databases is reached.
+    */
+    void preload();
+
+    /**
+        Opens the database in a dedicated transaction, a write transaction if
+        flags contain MDB_CREATE. Must not be called with create from a thread
+        that holds a write transaction of this environment.
+        Throws if the database was opened before with other flags. Comparators
+        are installed by the first open asking for them, asking for different
+        ones later throws.
+    */
+    dbi open(const std::string& name, unsigned int flags = 0, MDB_cmp_func* compare = nullptr, MDB_cmp_func* dupsort = nullptr);
+
+    /**
+        Like open, but a database that is not registered yet, for instance
+        created in txn or by another process, is opened in txn with
+        mdb_dbi_open. Such a handle is only cached by a later open, after txn
+        commits; as with mdb_dbi_open, no other transaction may open a
+        database that is not registered yet until txn ends.
+        A database registered after txn began is opened in txn as well, which
+        needs its handle to be the next one txn can take, otherwise this
+        throws. LMDB closes a handle opened that way if txn aborts.
+    */
+    dbi open(MDB_txn* txn, const std::string& name, unsigned int flags = 0, MDB_cmp_func* compare = nullptr, MDB_cmp_func* dupsort = nullptr);
+
+    /**
+        Enables the key filter of a named database, consulted by every get
+        through dbi before the B-tree is searched. The side file is used if it
+        was saved at the last committed transaction, otherwise the filter is
+        built in the background and answers positively until it is ready.
+        Commits of other processes are noticed, the filter answers positively
+        and is rebuilt after them.
+        Must not be called from a thread that holds a transaction of this environment.
+    */
+    key_filter& enable_filter(const std::string& name, const key_filter::options& opts = key_filter::options());
+
+    /**
+        @return the filter of the database, or null
+    */
+    key_filter* filter(MDB_dbi db) const;
+
+    /**
+        Called by write_txn::commit, and the write transactions of the
+        registry itself, right before a top-level commit. Readers see the
+        commit as local from then on, even before mdb_txn_commit returns.
+    */
+    void committing(uint64_t txnid);
+
+    /**
+        Called after the commit succeeded, so the filters can tell the commits
+        that did not go through here. A commit without changes does not use
+        its id and is treated as abandoned.
+    */
+    void committed(uint64_t txnid);
+
+    /**
+        Called after the commit failed.
+    */
+    void abandoned(uint64_t txnid);
+
+    /**
+        @param last last committed transaction of the environment
+        @return newest transaction up to last known not to be committed
+            through write_txn::commit, 0 if there is none
+    */
+    uint64_t last_foreign(uint64_t last) const;
+
+private:
+    typedef std::map<std::string, entry> table;
+    typedef std::map<MDB_dbi, std::shared_ptr<key_filter>> filter_table;
+    typedef std::map<MDB_dbi, std::string> name_table;
+
+    std::optional<entry> lookup(const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort);
+    std::optional<entry> open_dedicated(const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort);
+    /**
+        @return the handle mdb_dbi_open would assign in txn to a database it cannot see yet
+    */
+    MDB_dbi next_slot(MDB_txn* txn) const;
+    void publish(const std::string& name, const entry& e);
+
+    MDB_env *env_;
+    std::mutex mutex_;
+    /**
+        Guards enabling filters, taken with the write lock held, never the other way around.
+    */
+    std::mutex filters_mutex_;
+    std::shared_ptr<const table> table_;
+    /**
+        Databases found missing by open, with the last transaction at the probe, guarded by mutex_.
+    */
+    std::map<std::string, uint64_t> absent_;
+    std::shared_ptr<const filter_table> filters_;
+    std::mutex names_mutex_;
+    std::shared_ptr<const name_table> names_;
+    std::atomic<bool> has_filters_;
+    std::atomic<uint64_t> last_commit_;
+    std::atomic<uint64_t> last_gap_;
+    std::atomic<uint64_t> in_flight_;
+};
+
+}
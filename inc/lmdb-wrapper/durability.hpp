@@ -0,0 +1,80 @@
+#pragma once
+
+#include <lmdb.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace lmdb {
+
+/**
+    Bounds the data lost on a crash when commits do not sync: the environment
+    is synced every interval, or after the given number of commits if that
+    comes first, 0 disables the commit trigger.
+*/
+struct durability_policy {
+    std::chrono::milliseconds interval{100};
+    size_t commits = 0;
+};
+
+/**
+    Background thread syncing an environment opened with MDB_NOSYNC according
+    to a durability policy. Commits through write_txn are counted, commits
+    made otherwise are only picked up by the interval.
+*/
+class flusher {
+public:
+    flusher(MDB_env* env, const durability_policy& policy);
+
+    /**
+        Syncs once more, then stops.
+    */
+    ~flusher();
+
+    flusher(const flusher&) = delete;
+    flusher& operator=(const flusher&) = delete;
+
+    void committed();
+
+    /**
+        Ids up to the next one a write transaction gets are accepted, so the
+        id of a transaction still running can be waited on; if it aborts, the
+        future completes with the next commit, which reuses the id, or fails
+        when the environment closes.
+        @return a future completed once the transaction and all before it are on disk
+        @throws std::runtime_error for ids past the next one
+    */
+    std::future<void> durable(uint64_t txnid);
+
+    /**
+        Requests a sync without waiting for the policy.
+        @return a future completed once everything committed so far is on disk
+    */
+    std::future<void> flush();
+
+    /**
+        Last transaction known to be on disk.
+    */
+    uint64_t durable_txnid() const;
+
+private:
+    std::future<void> wait_locked(uint64_t txnid);
+    void run();
+
+    MDB_env *env_;
+    durability_policy policy_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    uint64_t durable_;
+    size_t pending_;
+    bool requested_;
+    bool stop_;
+    std::multimap<uint64_t, std::promise<void>> waiters_;
+    std::thread thread_;
+};
+
+}
@@ -1,14 +1,21 @@
 #pragma once
 
 #include "lmdb-wrapper/txn.hpp"
+#include "lmdb-wrapper/durability.hpp"
+#include "lmdb-wrapper/reader_monitor.hpp"
+#include "lmdb-wrapper/warmup.hpp"
 
 #include <lmdb.h>
+#include <cstdint>
+#include <future>
 #include <memory>
 #include <string>
 #include <optional>
 
 namespace lmdb {
 
+class dbi_registry;
+
 class env {
 public:
     class deleter;
@@ -32,6 +39,33 @@ public:
     env(std::shared_ptr<MDB_env> env);
     MDB_env* handle() const;
 
+    /**
+        Registry of the named databases, only available for environments opened through env::factory.
+    */
+    dbi_registry& dbis() const;
+
+    /**
+        Completes once the transaction, see txn::id, and all before it are on
+        disk. Requires a durability policy, see flusher::durable for the
+        ids accepted.
+    */
+    std::future<void> durable(uint64_t txnid) const;
+
+    /**
+        Syncs ahead of the durability policy, completes once everything committed so far is on disk.
+    */
+    std::future<void> flush() const;
+
+    /**
+        Saves the pages resident right now as the profile prefetched by the next open.
+    */
+    void save_page_profile() const;
+
+    /**
+        Reader monitor of the env, only available if the factory started one.
+    */
+    reader_monitor& monitor() const;
+
 private:
     std::shared_ptr<MDB_env> env_;
 };
@@ -46,6 +80,18 @@ public:
     factory& set_map_size(size_t);
     factory& set_max_readers(unsigned int);
     factory& set_max_dbs(MDB_dbi);
+    /**
+        Opens the env with nosync and syncs it in the background according to the policy.
+    */
+    factory& set_durability(const durability_policy&);
+    /**
+        Warms the page cache up before open returns, see warmup_options.
+    */
+    factory& set_warmup(const warmup_options&);
+    /**
+        Starts a thread reporting stale readers and space usage, see reader_monitor.
+    */
+    factory& set_reader_monitor(const reader_monitor_options&, reader_monitor::callback on_stale = nullptr);
     factory& set(env::flags);
     bool get(env::flags) const;
     factory& unset(env::flags);
@@ -56,7 +102,11 @@ private:
     std::optional<size_t> map_size_;
     std::optional<unsigned int> max_readers_;
     std::optional<MDB_dbi> max_dbs_;
-    unsigned int flags_;
+    std::optional<durability_policy> durability_;
+    std::optional<warmup_options> warmup_;
+    std::optional<reader_monitor_options> monitor_;
+    reader_monitor::callback on_stale_;
+    unsigned int flags_ = 0;
 };
 
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "lmdb-wrapper/dbi_registry.hpp"
+#include "lmdb-wrapper/durability.hpp"
+#include "lmdb-wrapper/reader_monitor.hpp"
+#include "lmdb-wrapper/warmup.hpp"
+
+#include <lmdb.h>
+#include <memory>
+#include <optional>
+
+namespace lmdb {
+
+/**
+    State kept for every environment opened through env::factory, stored as
+    its user context and destroyed right before the environment closes.
+*/
+class env_context {
+public:
+    env_context(MDB_env* env);
+
+    /**
+        Saves the page profile if the warm-up options ask for it.
+    */
+    ~env_context();
+
+    env_context(const env_context&) = delete;
+    env_context& operator=(const env_context&) = delete;
+
+    /**
+        @return the context of an environment opened through env::factory, or null
+    */
+    static env_context* of(MDB_env* env);
+
+    dbi_registry& registry();
+
+    /**
+        @return the flusher of an environment with a durability policy, or null
+    */
+    lmdb::flusher* flusher() const;
+
+    void start_flusher(const durability_policy& policy);
+
+    /**
+        @return the reader monitor, or null
+    */
+    reader_monitor* monitor() const;
+
+    void start_monitor(const reader_monitor_options& opts, reader_monitor::callback on_stale);
+
+    const std::optional<warmup_options>& warmup() const;
+
+    void set_warmup(const warmup_options& opts);
+
+private:
+    MDB_env *env_;
+    dbi_registry registry_;
+    std::unique_ptr<lmdb::flusher> flusher_;
+    std::unique_ptr<reader_monitor> monitor_;
+    std::optional<warmup_options> warmup_;
+};
+
+}
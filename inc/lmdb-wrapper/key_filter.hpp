@@ -0,0 +1,144 @@
+#pragma once
+
+#include <lmdb.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace lmdb {
+
+/**
+    Approximate membership filter over the keys of one database, a blocked
+    Bloom filter with one cache line per key. A negative answer is exact, so
+    lookups of absent keys skip the B-tree entirely.
+
+    Keys are added when they are put, before the transaction commits, so the
+    filter always covers the committed data; aborted puts only cost false
+    positives. Puts made with mdb_put must go through dbi::filter_put. A
+    commit that did not go through write_txn::commit, such as a commit of
+    another process, makes the filter answer positively until it is rebuilt.
+
+    Deleted keys cannot be removed, they are counted instead and the filter
+    is rebuilt in the background from a cursor scan once they exceed
+    rebuild_ratio of its entries. Until the first build completes every key
+    may be contained.
+
+    Filters are owned by the dbi_registry of the environment, see
+    dbi_registry::enable_filter.
+*/
+class key_filter {
+public:
+    struct options {
+        double false_positive_rate = 0.01;
+        /**
+            Upper bound of the filter size, the false positive rate rises when it is reached.
+        */
+        size_t max_bytes = 64 << 20;
+        /**
+            Number of keys to size the filter for, 0 sizes it for the current entries plus a quarter.
+        */
+        size_t expected_keys = 0;
+        double rebuild_ratio = 0.25;
+        /**
+            Side file the filter is saved to when the environment closes, empty for the
+            default next to the data file.
+        */
+        std::string path;
+        bool persist = true;
+    };
+
+    key_filter(MDB_env* env, MDB_dbi dbi, const options& opts);
+    ~key_filter();
+
+    key_filter(const key_filter&) = delete;
+    key_filter& operator=(const key_filter&) = delete;
+
+    /**
+        @param foreign newest transaction not committed through write_txn::commit,
+            see dbi_registry::last_foreign; a rebuild starts if the filter misses it
+        @return false if the key is certainly not in the database
+    */
+    bool may_contain(const MDB_val& key, uint64_t foreign);
+
+    void add(const MDB_val& key);
+
+    void removed();
+
+    bool ready() const;
+
+    /**
+        Keys in the filter. A put of a key the filter already answers
+        positively for is taken as an overwrite and not counted, so new keys
+        are undercounted by about the false positive rate.
+    */
+    size_t entries() const;
+
+    /**
+        Deletes since the last build.
+    */
+    size_t stale() const;
+
+    size_t size_bytes() const;
+
+    /**
+        Builds started since the filter was enabled, the first one included.
+    */
+    size_t builds() const;
+
+    /**
+        Starts a background rebuild unless one is running.
+    */
+    void rebuild();
+
+    /**
+        Stops a running rebuild and waits for it, must not be called while
+        holding a write transaction of the environment.
+    */
+    void stop();
+
+    /**
+        Writes the filter to its side file, tagged with the last committed
+        transaction. The caller must hold the write lock of the environment.
+    */
+    void save(uint64_t txnid) const;
+
+    /**
+        Replaces the filter with its side file if that was saved at the last
+        committed transaction. The caller must hold the write lock of the environment.
+        @return false if there is no usable side file
+    */
+    bool load(uint64_t txnid);
+
+    const std::string& path() const;
+
+    bool persistent() const;
+
+private:
+    struct bits;
+
+    std::shared_ptr<bits> make_bits(size_t keys) const;
+    void build();
+
+    MDB_env *env_;
+    MDB_dbi dbi_;
+    options options_;
+    std::shared_ptr<bits> live_;
+    std::shared_ptr<bits> pending_;
+    std::atomic<bool> ready_;
+    /**
+        Transaction the filter was built or saved at, it holds every key committed up to it.
+    */
+    std::atomic<uint64_t> base_;
+    std::atomic<size_t> entries_;
+    std::atomic<size_t> stale_;
+    std::atomic<size_t> builds_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> building_;
+    std::mutex builder_mutex_;
+    std::thread builder_;
+};
+
+}
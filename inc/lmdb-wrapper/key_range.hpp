@@ -0,0 +1,85 @@
+#pragma once
+
+#include "lmdb-wrapper/value.hpp"
+
+#include <lmdb.h>
+#include <string>
+
+namespace lmdb {
+
+/**
+    Keys visited by a scan: the half open interval [lo, hi), the keys starting
+    with a prefix, or everything, in ascending or, once reversed, descending
+    order. Bounds are kept packed and checked against the raw keys with the
+    ordering of the database, so entries outside the range are never decoded.
+    Prefixes match bytes and assume a bytewise key ordering.
+*/
+class key_range {
+public:
+    key_range();
+
+    static key_range all();
+
+    template <class K>
+    static key_range between(const K& lo, const K& hi) {
+        key_range result;
+        result.set_lo(value::pack(lo));
+        result.set_hi(value::pack(hi));
+        return result;
+    }
+
+    template <class K>
+    static key_range from(const K& lo) {
+        key_range result;
+        result.set_lo(value::pack(lo));
+        return result;
+    }
+
+    template <class K>
+    static key_range until(const K& hi) {
+        key_range result;
+        result.set_hi(value::pack(hi));
+        return result;
+    }
+
+    template <class K>
+    static key_range prefix(const K& p) {
+        key_range result;
+        result.set_prefix(value::pack(p));
+        return result;
+    }
+
+    key_range reversed() const;
+
+    bool is_reverse() const;
+
+    /**
+        Positions the cursor at the first entry of the range in scan order.
+        @return 0 or an LMDB error, MDB_NOTFOUND if the range is empty
+    */
+    int first(MDB_cursor* cursor, MDB_val& key, MDB_val& data) const;
+
+    /**
+        Moves the cursor to the following entry in scan order.
+        @return 0 or an LMDB error, MDB_NOTFOUND past the end of the range
+    */
+    int next(MDB_cursor* cursor, MDB_val& key, MDB_val& data) const;
+
+    bool contains(MDB_txn* txn, MDB_dbi dbi, const MDB_val& key) const;
+
+private:
+    void set_lo(const MDB_val&);
+    void set_hi(const MDB_val&);
+    void set_prefix(const MDB_val&);
+    int check(MDB_cursor* cursor, int err, const MDB_val& key) const;
+
+    std::string lo_;
+    std::string hi_;
+    std::string prefix_;
+    bool has_lo_;
+    bool has_hi_;
+    bool has_prefix_;
+    bool reverse_;
+};
+
+}
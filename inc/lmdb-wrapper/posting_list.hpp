@@ -0,0 +1,448 @@
+#pragma once
+
+#include "lmdb-wrapper/env.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    Sorted sequence of the duplicate values of one key in a dup_sort database.
+    Values are compared in their stored form with the ordering of the
+    database and only decoded on request. dup_fixed databases are read a page
+    at a time with MDB_GET_MULTIPLE/MDB_NEXT_MULTIPLE and searched in memory.
+*/
+template <class V>
+class posting_list {
+public:
+    template <class K>
+    posting_list(MDB_txn* txn, const dbi& db, const K& key);
+
+    posting_list(posting_list&&) = default;
+    posting_list& operator=(posting_list&&) = default;
+
+    bool valid() const;
+
+    const MDB_val& current() const;
+
+    V value() const;
+
+    /**
+        Moves to the next duplicate.
+    */
+    void next();
+
+    /**
+        Moves forward to the first duplicate not less than target, galloping
+        through the buffered page before falling back to MDB_GET_BOTH_RANGE.
+    */
+    void seek(const MDB_val& target);
+
+    int compare(const MDB_val& a, const MDB_val& b) const;
+
+private:
+    MDB_val at(size_t index) const;
+    void load_page();
+    void set_current(int err, const MDB_val& data);
+
+    MDB_txn *txn_;
+    MDB_dbi dbi_;
+    std::unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> cursor_;
+    std::string key_;
+    bool integer_;
+    bool bulk_;
+    bool valid_;
+    MDB_val current_;
+
+    // current page of a dup_fixed database
+    const char *page_;
+    size_t width_;
+    size_t count_;
+    size_t index_;
+};
+
+enum class set_op {
+    intersect,
+    unite,
+    subtract
+};
+
+/**
+    Iterates the values of a set operation over posting lists in ascending
+    order: intersect yields values present in every list, unite values present
+    in any list and subtract the values of the first list missing from the rest.
+*/
+template <class V>
+class posting_iterator {
+public:
+    posting_iterator() = default;
+
+    posting_iterator(set_op op, std::vector<posting_list<V>> lists);
+
+    /**
+        Combines the duplicates of each key in the database.
+    */
+    template <class K>
+    posting_iterator(const txn_base& txn, set_op op, const dbi& db, const std::vector<K>& keys);
+
+    posting_iterator(posting_iterator&&) = default;
+    posting_iterator& operator=(posting_iterator&&) = default;
+
+    const V& operator*() const;
+
+    const V* operator->() const;
+
+    posting_iterator& operator++();
+
+    bool operator==(const posting_iterator& it) const;
+
+    bool operator!=(const posting_iterator& it) const;
+
+    const MDB_val& raw() const;
+
+private:
+    void advance(bool step);
+    bool align_intersect();
+    bool align_unite();
+    bool align_subtract();
+
+    set_op op_;
+    std::vector<posting_list<V>> lists_;
+    std::optional<MDB_val> raw_;
+    std::optional<V> value_;
+};
+
+
+template <class V>
+template <class K>
+posting_list<V>::posting_list(MDB_txn* txn, const dbi& db, const K& key):
+    txn_{txn}, dbi_{db.handle()}, cursor_{nullptr, mdb_cursor_close}, integer_{false}, bulk_{false}, valid_{false},
+    page_{nullptr}, width_{0}, count_{0}, index_{0} {
+
+    MDB_val k = value::pack(key);
+    key_.assign(static_cast<const char*>(k.mv_data), k.mv_size);
+
+    unsigned int flags;
+    if (mdb_dbi_flags(txn_, dbi_, &flags)) {
+        throw std::runtime_error("invalid dbi");
+    }
+    integer_ = flags & MDB_INTEGERDUP;
+    bulk_ = flags & MDB_DUPFIXED;
+
+    MDB_cursor *cur;
+    if (mdb_cursor_open(txn_, dbi_, &cur)) {
+        throw std::runtime_error("failed to open cursor");
+    }
+    cursor_.reset(cur);
+
+    k = MDB_val{key_.size(), key_.data()};
+    MDB_val data;
+    int err = mdb_cursor_get(cursor_.get(), &k, &data, MDB_SET);
+    if (!err && bulk_) {
+        load_page();
+    } else {
+        set_current(err, data);
+    }
+}
+
+template <class V>
+bool posting_list<V>::valid() const {
+    return valid_;
+}
+
+template <class V>
+const MDB_val& posting_list<V>::current() const {
+    if (!valid_) {
+        throw std::runtime_error("invalid posting list");
+    }
+    return current_;
+}
+
+template <class V>
+V posting_list<V>::value() const {
+    object<V> obj(current());
+    return obj.value();
+}
+
+template <class V>
+void posting_list<V>::next() {
+    if (!valid_) {
+        return;
+    }
+    if (bulk_) {
+        if (++index_ < count_) {
+            current_ = at(index_);
+            return;
+        }
+        MDB_val k, data;
+        int err = mdb_cursor_get(cursor_.get(), &k, &data, MDB_NEXT_MULTIPLE);
+        if (err) {
+            set_current(err, data);
+            return;
+        }
+        page_ = static_cast<const char*>(data.mv_data);
+        count_ = data.mv_size / width_;
+        index_ = 0;
+        current_ = at(0);
+        return;
+    }
+    MDB_val k, data;
+    set_current(mdb_cursor_get(cursor_.get(), &k, &data, MDB_NEXT_DUP), data);
+}
+
+template <class V>
+void posting_list<V>::seek(const MDB_val& target) {
+    if (!valid_ || compare(current_, target) >= 0) {
+        return;
+    }
+    if (bulk_ && compare(at(count_ - 1), target) >= 0) {
+        // exponential search from the current position, then binary search
+        size_t lo = index_ + 1, step = 1;
+        size_t hi = lo;
+        while (hi < count_ - 1 && compare(at(hi), target) < 0) {
+            lo = hi + 1;
+            hi = std::min(count_ - 1, hi + step);
+            step *= 2;
+        }
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (compare(at(mid), target) < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        index_ = lo;
+        current_ = at(index_);
+        return;
+    }
+
+    MDB_val k{key_.size(), key_.data()};
+    MDB_val data = target;
+    int err = mdb_cursor_get(cursor_.get(), &k, &data, MDB_GET_BOTH_RANGE);
+    if (!err && bulk_) {
+        load_page();
+    } else {
+        set_current(err, data);
+    }
+}
+
+template <class V>
+int posting_list<V>::compare(const MDB_val& a, const MDB_val& b) const {
+    if constexpr (std::is_integral_v<V>) {
+        if (integer_ && a.mv_size == sizeof(V) && b.mv_size == sizeof(V)) {
+            V x = value::unpack<V>(a), y = value::unpack<V>(b);
+            return (x > y) - (x < y);
+        }
+    }
+    return mdb_dcmp(txn_, dbi_, &a, &b);
+}
+
+template <class V>
+MDB_val posting_list<V>::at(size_t index) const {
+    return MDB_val{width_, const_cast<char*>(page_ + index * width_)};
+}
+
+template <class V>
+void posting_list<V>::load_page() {
+    // MDB_GET_MULTIPLE returns the whole page holding the current duplicate,
+    // so position inside it at the first entry not less than the current one
+    MDB_val k, current, data{0, nullptr};
+    int err = mdb_cursor_get(cursor_.get(), &k, &current, MDB_GET_CURRENT);
+    if (!err) {
+        err = mdb_cursor_get(cursor_.get(), &k, &data, MDB_GET_MULTIPLE);
+    }
+    if (err) {
+        set_current(err, data);
+        return;
+    }
+    // a key with a single value has no page of duplicates, MDB_GET_MULTIPLE
+    // succeeds without returning one
+    if (!data.mv_size || !current.mv_size) {
+        set_current(0, current);
+        bulk_ = false;
+        return;
+    }
+    width_ = current.mv_size;
+    page_ = static_cast<const char*>(data.mv_data);
+    count_ = data.mv_size / width_;
+    size_t lo = 0, hi = count_ - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (compare(at(mid), current) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    index_ = lo;
+    valid_ = true;
+    current_ = at(index_);
+}
+
+template <class V>
+void posting_list<V>::set_current(int err, const MDB_val& data) {
+    switch (err) {
+        case 0:
+            valid_ = true;
+            current_ = data;
+            break;
+        case MDB_NOTFOUND:
+            valid_ = false;
+            break;
+        default:
+            valid_ = false;
+            throw std::runtime_error("cursor error");
+    }
+}
+
+
+template <class V>
+posting_iterator<V>::posting_iterator(set_op op, std::vector<posting_list<V>> lists):op_{op}, lists_{std::move(lists)} {
+    advance(false);
+}
+
+template <class V>
+template <class K>
+posting_iterator<V>::posting_iterator(const txn_base& txn, set_op op, const dbi& db, const std::vector<K>& keys):op_{op} {
+    for (const auto& key : keys) {
+        lists_.emplace_back(txn.handle(), db, key);
+    }
+    advance(false);
+}
+
+template <class V>
+const V& posting_iterator<V>::operator*() const {
+    if (!value_) {
+        throw std::runtime_error("invalid iterator");
+    }
+    return *value_;
+}
+
+template <class V>
+const V* posting_iterator<V>::operator->() const {
+    return &(**this);
+}
+
+template <class V>
+posting_iterator<V>& posting_iterator<V>::operator++() {
+    if (raw_) {
+        advance(true);
+    }
+    return *this;
+}
+
+template <class V>
+bool posting_iterator<V>::operator==(const posting_iterator<V>& it) const {
+    if (!raw_ || !it.raw_) {
+        return !raw_ && !it.raw_;
+    }
+    return *value_ == *it.value_;
+}
+
+template <class V>
+bool posting_iterator<V>::operator!=(const posting_iterator<V>& it) const {
+    return ! (*this == it);
+}
+
+template <class V>
+const MDB_val& posting_iterator<V>::raw() const {
+    if (!raw_) {
+        throw std::runtime_error("invalid iterator");
+    }
+    return *raw_;
+}
+
+template <class V>
+void posting_iterator<V>::advance(bool step) {
+    if (step) {
+        MDB_val last = *raw_;
+        if (op_ == set_op::unite) {
+            // step every list sitting on the emitted value
+            for (auto& list : lists_) {
+                if (list.valid() && !list.compare(list.current(), last)) {
+                    list.next();
+                }
+            }
+        } else {
+            lists_.front().next();
+        }
+    }
+
+    bool found = false;
+    if (!lists_.empty()) {
+        switch (op_) {
+            case set_op::intersect: found = align_intersect(); break;
+            case set_op::unite: found = align_unite(); break;
+            case set_op::subtract: found = align_subtract(); break;
+        }
+    }
+    raw_.reset();
+    value_.reset();
+    if (found) {
+        auto& source = op_ == set_op::unite?
+            *std::min_element(lists_.begin(), lists_.end(), [](const auto& x, const auto& y) {
+                return x.valid() && (!y.valid() || x.compare(x.current(), y.current()) < 0);
+            }) : lists_.front();
+        raw_ = source.current();
+        value_ = source.value();
+    }
+}
+
+template <class V>
+bool posting_iterator<V>::align_intersect() {
+    // leapfrog: seek every list to the largest current value until they agree
+    size_t agreed = 0, i = 0;
+    while (true) {
+        auto& list = lists_[i];
+        if (!list.valid()) {
+            return false;
+        }
+        const MDB_val target = lists_[(i + lists_.size() - 1) % lists_.size()].current();
+        if (agreed) {
+            list.seek(target);
+            if (!list.valid()) {
+                return false;
+            }
+            if (list.compare(list.current(), target)) {
+                agreed = 0;
+            }
+        }
+        if (++agreed == lists_.size()) {
+            return true;
+        }
+        i = (i + 1) % lists_.size();
+    }
+}
+
+template <class V>
+bool posting_iterator<V>::align_unite() {
+    return std::any_of(lists_.begin(), lists_.end(), [](const auto& list) {
+        return list.valid();
+    });
+}
+
+template <class V>
+bool posting_iterator<V>::align_subtract() {
+    auto& base = lists_.front();
+    while (base.valid()) {
+        const MDB_val candidate = base.current();
+        bool excluded = false;
+        for (size_t i = 1; i < lists_.size() && !excluded; ++i) {
+            lists_[i].seek(candidate);
+            excluded = lists_[i].valid() && !lists_[i].compare(lists_[i].current(), candidate);
+        }
+        if (!excluded) {
+            return true;
+        }
+        base.next();
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <lmdb.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace lmdb {
+
+struct reader_monitor_options {
+    std::chrono::milliseconds interval{1000};
+    /**
+        Minimum time between two counts of the free pages, which walks the
+        whole free database; a count is skipped as well when nothing was
+        committed since the last one.
+    */
+    std::chrono::milliseconds freelist_interval{60000};
+    /**
+        Readers older than this, or lagging more transactions behind the last
+        commit, are reported to the callback, once each.
+    */
+    std::chrono::milliseconds max_age{60000};
+    uint64_t max_lag = 10000;
+    /**
+        Remember when and where each read_txn of this process began. Every
+        read transaction then takes a lock shared by all readers of the env
+        as it begins and ends, so this is meant for debugging.
+    */
+    bool track_origins = false;
+};
+
+/**
+    One slot of the reader table.
+*/
+struct reader_info {
+    int pid;
+    /**
+        Thread id as printed by mdb_reader_list.
+    */
+    uint64_t thread;
+    /**
+        Snapshot held, none for an idle slot kept by a reset transaction.
+    */
+    std::optional<uint64_t> txnid;
+    /**
+        Transactions committed since the snapshot.
+    */
+    uint64_t lag;
+    /**
+        Time since the transaction began if it was tracked, otherwise since the monitor first saw it.
+    */
+    std::chrono::milliseconds age;
+    bool tracked;
+    /**
+        Label of the thread that began the transaction, see reader_monitor::label_thread.
+    */
+    const char *label;
+};
+
+/**
+    Space used by the environment, with the growth since the previous sample;
+    free_growth only moves when the free pages are recounted.
+*/
+struct space_info {
+    uint64_t last_txnid;
+    size_t page_size;
+    size_t map_size;
+    size_t used_pages;
+    /**
+        Free pages as of the commit free_txnid, only recounted every
+        freelist_interval.
+    */
+    size_t free_pages;
+    uint64_t free_txnid;
+    /**
+        Records of the free database, read from its stat at every sample.
+    */
+    size_t freelist_entries;
+    int64_t used_growth;
+    int64_t free_growth;
+    size_t dead_readers;
+};
+
+/**
+    Thread watching the reader table of an environment. Every interval it
+    clears the slots of dead processes with mdb_reader_check, lists the
+    readers with their age and lag and reports the ones over the limits, and
+    samples the size of the file and the freelist, the free pages less often
+    since counting them costs a walk of the freelist. Readers pinning an old
+    snapshot keep the pages freed since from being reused, which shows as
+    used pages growing while free pages stay flat.
+*/
+class reader_monitor {
+public:
+    typedef std::function<void(const reader_info&)> callback;
+
+    reader_monitor(MDB_env* env, const reader_monitor_options& opts, callback on_stale);
+    ~reader_monitor();
+
+    reader_monitor(const reader_monitor&) = delete;
+    reader_monitor& operator=(const reader_monitor&) = delete;
+
+    /**
+        Lists the readers now.
+    */
+    std::vector<reader_info> readers();
+
+    /**
+        Latest sample of the space used.
+    */
+    space_info space() const;
+
+    /**
+        Names the calling thread in the reader reports, the label must outlive
+        the thread. Only used when track_origins is set.
+    */
+    static void label_thread(const char* label);
+
+    /**
+        Called by read transactions as they begin and end.
+    */
+    static void began(MDB_txn* txn);
+    static void ended(MDB_txn* txn);
+
+private:
+    struct origin {
+        uint64_t thread;
+        uint64_t txnid;
+        std::chrono::steady_clock::time_point start;
+        const char *label;
+    };
+
+    typedef std::tuple<int, uint64_t, uint64_t> reader_key;
+
+    static reader_monitor* of(MDB_txn* txn);
+
+    void run();
+    space_info sample();
+    void count_free(MDB_txn* txn, space_info& s);
+    std::vector<reader_info> list(uint64_t last_txnid);
+
+    MDB_env *env_;
+    reader_monitor_options options_;
+    callback on_stale_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    // taken by the readers, held only to copy the origins out
+    std::mutex origins_mutex_;
+    std::unordered_map<MDB_txn*, origin> origins_;
+    std::map<reader_key, std::chrono::steady_clock::time_point> first_seen_;
+    std::set<reader_key> reported_;
+    space_info space_;
+    // last count of the free pages, only used by the monitor thread
+    std::optional<std::chrono::steady_clock::time_point> counted_at_;
+    space_info counted_;
+    std::thread thread_;
+};
+
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+#include "lmdb-wrapper/value.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+namespace lmdb {
+
+/**
+    A field of a flat record, identified by a stable id. T is either trivially
+    copyable or std::string_view for variable length data.
+*/
+template <uint16_t Id, class T>
+struct field {
+    static_assert(std::is_trivially_copyable_v<T> || std::is_same_v<T, std::string_view>,
+        "record fields must be trivially copyable or std::string_view");
+    static_assert(Id != UINT16_MAX, "field id 65535 is reserved");
+    static constexpr uint16_t id = Id;
+    typedef T type;
+};
+
+/**
+    Record layout declared once as a list of fields:
+
+        using id = field<0, uint64_t>;
+        using name = field<1, std::string_view>;
+        using user = schema<1, id, name>;
+
+    Records start with the schema version and an offset table indexed by field
+    id, followed by the field data. Fields are optional, a zero offset marks a
+    missing one. Each field starts with a tag holding its size, with the top
+    bit set for variable length data, so reading a field with a type of
+    another size or kind throws instead of returning garbage. A schema
+    evolves by adding fields with new ids and dropping fields it no longer
+    reads; ids must never be reused with another type, types of the same
+    size are not told apart.
+*/
+template <uint16_t Version, class... Fields>
+struct schema {
+private:
+    static constexpr bool unique_ids() {
+        constexpr uint16_t ids[] = {Fields::id..., 0};
+        for (size_t i = 0; i < sizeof...(Fields); ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                if (ids[i] == ids[j]) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+public:
+    static_assert(unique_ids(), "field ids of a schema must be unique");
+
+    static constexpr uint16_t version = Version;
+    static constexpr uint16_t slots = std::max({uint16_t(0), uint16_t(Fields::id + 1)...});
+
+    template <class F>
+    static constexpr bool contains = (std::is_same_v<F, Fields> || ...);
+
+    template <class F>
+    static constexpr size_t index() {
+        constexpr bool matches[] = {std::is_same_v<F, Fields>...};
+        for (size_t i = 0; i < sizeof...(Fields); ++i) {
+            if (matches[i]) {
+                return i;
+            }
+        }
+        return sizeof...(Fields);
+    }
+};
+
+namespace record_layout {
+    constexpr size_t header_size = 2 * sizeof(uint16_t);
+    constexpr size_t offset_size = sizeof(uint32_t);
+    constexpr size_t tag_size = sizeof(uint32_t);
+    constexpr uint32_t variable = 0x80000000;
+}
+
+/**
+    Reads the fields of an encoded record in place, typically straight from
+    the memory map. Only valid while the underlying data is.
+*/
+template <class Schema>
+class record_view {
+public:
+    record_view():data_{nullptr}, size_{0} {
+    }
+
+    record_view(const MDB_val& val):data_{static_cast<const char*>(val.mv_data)}, size_{val.mv_size} {
+        if (size_ && size_ < record_layout::header_size + table_size() * record_layout::offset_size) {
+            throw std::runtime_error("corrupted record");
+        }
+    }
+
+    /**
+        Schema version the record was written with.
+    */
+    uint16_t version() const {
+        return size_? read<uint16_t>(0) : 0;
+    }
+
+    template <class F>
+    bool has() const {
+        static_assert(Schema::template contains<F>, "field is not part of the schema");
+        return offset(F::id) != 0;
+    }
+
+    template <class F>
+    typename F::type get() const {
+        static_assert(Schema::template contains<F>, "field is not part of the schema");
+        size_t pos = offset(F::id);
+        if (!pos) {
+            throw std::runtime_error("field missing");
+        }
+        uint32_t tag = read<uint32_t>(pos);
+        pos += record_layout::tag_size;
+        if constexpr (std::is_same_v<typename F::type, std::string_view>) {
+            if (!(tag & record_layout::variable)) {
+                throw std::runtime_error("field type mismatch");
+            }
+            size_t length = tag & ~record_layout::variable;
+            if (pos + length > size_) {
+                throw std::runtime_error("corrupted record");
+            }
+            return std::string_view(data_ + pos, length);
+        } else {
+            if (tag != sizeof(typename F::type)) {
+                throw std::runtime_error("field type mismatch");
+            }
+            return read<typename F::type>(pos);
+        }
+    }
+
+    template <class F>
+    typename F::type get(const typename F::type& default_value) const {
+        return has<F>()? get<F>() : default_value;
+    }
+
+    MDB_val data() const {
+        return MDB_val{size_, const_cast<char*>(data_)};
+    }
+
+private:
+    size_t table_size() const {
+        return size_? read<uint16_t>(sizeof(uint16_t)) : 0;
+    }
+
+    size_t offset(uint16_t id) const {
+        if (id >= table_size()) {
+            return 0;
+        }
+        return read<uint32_t>(record_layout::header_size + id * record_layout::offset_size);
+    }
+
+    template <class T>
+    T read(size_t pos) const {
+        if (pos + sizeof(T) > size_) {
+            throw std::runtime_error("corrupted record");
+        }
+        T result;
+        std::memcpy(&result, data_ + pos, sizeof(T));
+        return result;
+    }
+
+    const char *data_;
+    size_t size_;
+};
+
+template <class Schema>
+class record_builder;
+
+/**
+    Collects field values and encodes them in the layout of the schema.
+*/
+template <uint16_t Version, class... Fields>
+class record_builder<schema<Version, Fields...>> {
+    typedef schema<Version, Fields...> schema_t;
+
+    template <class F>
+    using storage_t = std::conditional_t<std::is_same_v<typename F::type, std::string_view>, std::string, typename F::type>;
+
+public:
+    record_builder() = default;
+
+    /**
+        Copies the fields of a record known to this schema.
+    */
+    template <class OtherSchema>
+    record_builder(const record_view<OtherSchema>& view) {
+        (copy_field<Fields>(view), ...);
+    }
+
+    template <class F>
+    record_builder& set(const typename F::type& value) {
+        static_assert(schema_t::template contains<F>, "field is not part of the schema");
+        std::get<schema_t::template index<F>()>(values_) = storage_t<F>(value);
+        return *this;
+    }
+
+    template <class F>
+    record_builder& reset() {
+        static_assert(schema_t::template contains<F>, "field is not part of the schema");
+        std::get<schema_t::template index<F>()>(values_).reset();
+        return *this;
+    }
+
+    std::string encode() const {
+        size_t data_start = record_layout::header_size + schema_t::slots * record_layout::offset_size;
+        std::string out(data_start, '\0');
+        write<uint16_t>(out, 0, Version);
+        write<uint16_t>(out, sizeof(uint16_t), schema_t::slots);
+        (append<Fields>(out), ...);
+        return out;
+    }
+
+private:
+    template <class F, class OtherSchema>
+    void copy_field(const record_view<OtherSchema>& view) {
+        if constexpr (OtherSchema::template contains<F>) {
+            if (view.template has<F>()) {
+                set<F>(view.template get<F>());
+            }
+        }
+    }
+
+    template <class F>
+    void append(std::string& out) const {
+        const auto& value = std::get<schema_t::template index<F>()>(values_);
+        if (!value) {
+            return;
+        }
+        if (out.size() > UINT32_MAX) {
+            throw std::runtime_error("record too large");
+        }
+        write<uint32_t>(out, record_layout::header_size + F::id * record_layout::offset_size, static_cast<uint32_t>(out.size()));
+        if constexpr (std::is_same_v<typename F::type, std::string_view>) {
+            if (value->size() >= record_layout::variable) {
+                throw std::runtime_error("field too large");
+            }
+            uint32_t tag = static_cast<uint32_t>(value->size()) | record_layout::variable;
+            out.append(reinterpret_cast<const char*>(&tag), sizeof(tag));
+            out.append(*value);
+        } else {
+            uint32_t tag = sizeof(*value);
+            out.append(reinterpret_cast<const char*>(&tag), sizeof(tag));
+            out.append(reinterpret_cast<const char*>(&*value), sizeof(*value));
+        }
+    }
+
+    template <class T>
+    static void write(std::string& out, size_t pos, T value) {
+        std::memcpy(&out[pos], &value, sizeof(T));
+    }
+
+    std::tuple<std::optional<storage_t<Fields>>...> values_;
+};
+
+
+template <class Schema>
+class object<record_view<Schema>> {
+public:
+    object(const record_view<Schema>& val):val_{val.data()} {
+    }
+
+    object(MDB_val val):val_{val} {
+    }
+
+    record_view<Schema> value() const {
+        return record_view<Schema>(val_);
+    }
+
+    record_view<Schema> value(std::pmr::memory_resource*) const {
+        return value();
+    }
+
+    MDB_val* data() {
+        return &val_;
+    }
+
+private:
+    MDB_val val_;
+};
+
+template <class Schema>
+class object<record_builder<Schema>> {
+public:
+    object(const record_builder<Schema>& val):data_{val.encode()} {
+        val_.mv_size = data_.size();
+        val_.mv_data = data_.data();
+    }
+
+    MDB_val* data() {
+        return &val_;
+    }
+
+private:
+    std::string data_;
+    MDB_val val_;
+};
+
+}
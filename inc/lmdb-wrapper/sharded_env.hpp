@@ -0,0 +1,308 @@
+#pragma once
+
+#include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/txn.hpp"
+#include "lmdb-wrapper/db_iterator.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <algorithm>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    Maps a packed key to the index of the shard that owns it.
+*/
+class partitioner {
+public:
+    virtual ~partitioner() = default;
+    virtual size_t shard(const MDB_val& key) const = 0;
+    virtual size_t size() const = 0;
+};
+
+/**
+    Stable FNV-1a hash of the key bytes modulo the shard count.
+*/
+class hash_partitioner : public partitioner {
+public:
+    hash_partitioner(size_t shards);
+    size_t shard(const MDB_val& key) const override;
+    size_t size() const override;
+private:
+    size_t shards_;
+};
+
+/**
+    Partitions by the byte order of the keys. Shard i holds the keys in
+    [bounds[i - 1], bounds[i]), so n - 1 sorted bounds describe n shards.
+*/
+class range_partitioner : public partitioner {
+public:
+    range_partitioner(std::vector<std::string> bounds);
+    size_t shard(const MDB_val& key) const override;
+    size_t size() const override;
+
+    /**
+        Splits a shard at the given key, the keys from it onwards move to a new shard at index + 1.
+    */
+    void split(size_t index, const MDB_val& key);
+
+    bool contains(size_t index, const MDB_val& key) const;
+private:
+    std::vector<std::string> bounds_;
+};
+
+template <class K, class V>
+class shard_iterator;
+
+/**
+    A set of environments, each with its own writer thread, that behave as a
+    single store. Writes are queued to the owning shard and committed in
+    groups; the returned futures complete once the group is committed.
+*/
+class sharded_env {
+public:
+    class factory;
+    class shard;
+
+    sharded_env(const sharded_env&) = delete;
+    sharded_env& operator=(const sharded_env&) = delete;
+
+    ~sharded_env() = default;
+
+    template <class T, class K>
+    std::future<void> put(const std::string& db, const K& key, const T& value, unsigned int flags = 0);
+
+    template <class K>
+    std::future<void> del(const std::string& db, const K& key);
+
+    template <class T, class K>
+    T get(const std::string& db, const K& key) const;
+
+    template <class T, class K>
+    T get(const std::string& db, const K& key, const T& default_value) const;
+
+    /**
+        Ordered scan merging the database across all shards, limited to the range.
+    */
+    template <class K, class V>
+    shard_iterator<K, V> scan(const std::string& db, const key_range& range = key_range::all()) const;
+
+    /**
+        Moves the keys of shard index from key onwards, in every database,
+        to a new environment at path. Requires a range_partitioner and
+        databases ordered by their key bytes, without integer_key,
+        reverse_key or a comparator. The new shard is committed before the
+        keys are removed from the old one, and emptied again if that fails.
+    */
+    template <class K>
+    void split(size_t index, const K& key, const std::string& path);
+
+    size_t size() const;
+
+    env shard_env(size_t index) const;
+
+private:
+    struct db_spec {
+        std::string name;
+        unsigned int flags;
+        MDB_cmp_func *compare;
+        MDB_cmp_func *dupsort;
+    };
+
+    sharded_env(env::factory, mdb_mode_t, std::vector<std::unique_ptr<shard>>, std::shared_ptr<partitioner>, std::vector<db_spec>);
+
+    size_t db_index(const std::string& db) const;
+
+    void split_at(size_t index, const MDB_val& key, const std::string& path);
+
+    env::factory factory_;
+    mdb_mode_t mode_;
+    mutable std::shared_mutex mutex_;
+    std::vector<std::unique_ptr<shard>> shards_;
+    std::shared_ptr<partitioner> partitioner_;
+    std::vector<db_spec> dbs_;
+};
+
+class sharded_env::factory {
+public:
+    factory(env::factory);
+    factory& add_shard(const std::string& path);
+    factory& add_db(const std::string& name, unsigned int flags = MDB_CREATE, MDB_cmp_func* compare = nullptr, MDB_cmp_func* dupsort = nullptr);
+
+    /**
+        Defaults to a hash_partitioner over the added shards.
+    */
+    factory& set_partitioner(std::shared_ptr<partitioner>);
+
+    sharded_env open(mdb_mode_t);
+private:
+    env::factory env_factory_;
+    std::vector<std::string> paths_;
+    std::vector<db_spec> dbs_;
+    std::shared_ptr<partitioner> partitioner_;
+};
+
+class sharded_env::shard {
+public:
+    typedef std::function<void(write_txn&, const std::vector<dbi>&)> task;
+
+    shard(env, const std::vector<db_spec>&);
+    ~shard();
+
+    shard(const shard&) = delete;
+    shard& operator=(const shard&) = delete;
+
+    std::future<void> submit(task);
+
+    /**
+        Runs the task in a transaction of its own, never batched with other
+        tasks nor retried.
+    */
+    std::future<void> submit_alone(task);
+
+    const dbi& db(size_t index) const;
+
+    const env& environment() const;
+
+private:
+    struct operation {
+        task apply;
+        std::promise<void> done;
+        bool alone;
+    };
+
+    std::future<void> enqueue(task, bool alone);
+    void run();
+    void commit(std::deque<operation>& batch);
+
+    env env_;
+    std::vector<dbi> dbis_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<operation> queue_;
+    bool stop_;
+    std::thread writer_;
+};
+
+namespace detail {
+
+/**
+    Read transactions of the shards, a base of shard_iterator so that they
+    are created before the merge and destroyed after it.
+*/
+struct shard_snapshots {
+    std::vector<read_txn> txns;
+};
+
+}
+
+/**
+    Merged scan of one database over all shards, a db_iterator over one
+    read transaction per shard.
+*/
+template <class K, class V>
+class shard_iterator : private detail::shard_snapshots, public db_iterator<K, V> {
+public:
+    shard_iterator() = default;
+
+    shard_iterator(std::vector<read_txn> txns, const std::vector<dbi>& dbis, const key_range& range = key_range::all());
+
+    shard_iterator(shard_iterator&&) = default;
+
+    shard_iterator& operator=(shard_iterator&&) = default;
+
+    ~shard_iterator() = default;
+
+    size_t shard_index() const {
+        return this->dbi_index();
+    }
+
+private:
+    static std::vector<MDB_txn*> handles(const std::vector<read_txn>& txns);
+};
+
+
+template <class T, class K>
+std::future<void> sharded_env::put(const std::string& db, const K& key, const T& value, unsigned int flags) {
+    size_t index = db_index(db);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return shards_[partitioner_->shard(value::pack(key))]->submit(
+        [index, key, value, flags](write_txn& txn, const std::vector<dbi>& dbis) {
+            txn.template put<T>(dbis[index], key, value, flags);
+        });
+}
+
+template <class K>
+std::future<void> sharded_env::del(const std::string& db, const K& key) {
+    size_t index = db_index(db);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return shards_[partitioner_->shard(value::pack(key))]->submit(
+        [index, key](write_txn& txn, const std::vector<dbi>& dbis) {
+            txn.del(dbis[index], key);
+        });
+}
+
+template <class T, class K>
+T sharded_env::get(const std::string& db, const K& key) const {
+    size_t index = db_index(db);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto& target = shards_[partitioner_->shard(value::pack(key))];
+    read_txn txn(target->environment().handle());
+    return txn.template get<T>(target->db(index), key);
+}
+
+template <class T, class K>
+T sharded_env::get(const std::string& db, const K& key, const T& default_value) const {
+    size_t index = db_index(db);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto& target = shards_[partitioner_->shard(value::pack(key))];
+    read_txn txn(target->environment().handle());
+    return txn.template get<T>(target->db(index), key, default_value);
+}
+
+template <class K, class V>
+shard_iterator<K, V> sharded_env::scan(const std::string& db, const key_range& range) const {
+    size_t index = db_index(db);
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<read_txn> txns;
+    std::vector<dbi> dbis;
+    for (const auto& s : shards_) {
+        txns.emplace_back(s->environment().handle());
+        dbis.push_back(s->db(index));
+    }
+    return shard_iterator<K, V>(std::move(txns), dbis, range);
+}
+
+template <class K>
+void sharded_env::split(size_t index, const K& key, const std::string& path) {
+    split_at(index, value::pack(key), path);
+}
+
+
+template <class K, class V>
+shard_iterator<K, V>::shard_iterator(std::vector<read_txn> txns, const std::vector<dbi>& dbis, const key_range& range):
+    detail::shard_snapshots{std::move(txns)}, db_iterator<K, V>(handles(this->txns), dbis, range) {
+
+}
+
+template <class K, class V>
+std::vector<MDB_txn*> shard_iterator<K, V>::handles(const std::vector<read_txn>& txns) {
+    std::vector<MDB_txn*> result;
+    for (const auto& txn : txns) {
+        result.push_back(txn.handle());
+    }
+    return result;
+}
+
+}
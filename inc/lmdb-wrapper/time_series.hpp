@@ -0,0 +1,114 @@
+#pragma once
+
+#include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/txn.hpp"
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    Table of (timestamp, value) samples grouped into compressed blocks.
+    Blocks are keyed by (series id, block start time) in an order preserving
+    big endian encoding, timestamps are stored as delta of deltas and values
+    XOR'ed with their predecessor, both byte aligned. Samples of a series must
+    be appended in increasing time order; they are buffered in an open block
+    per series which is written once full, with MDB_APPEND when it sorts
+    after every key in the database, or on flush.
+
+    Appends and flushes belong to the write transaction they are made in:
+    the buffered state they change is restored if it aborts, so the table
+    must outlive the transactions it is used with, and only one at a time.
+*/
+class time_series {
+public:
+    struct samples {
+        std::vector<int64_t> time;
+        std::vector<double> value;
+    };
+
+    struct bucket {
+        int64_t start;
+        size_t count;
+        double min;
+        double max;
+        double sum;
+    };
+
+    time_series(const dbi& db, size_t block_samples = 240);
+
+    /**
+        Buffers a sample, writing the open block of the series in txn once it is full.
+    */
+    void append(write_txn& txn, uint64_t series, int64_t time, double value);
+
+    /**
+        Writes the partially filled open blocks. They stay open and are
+        rewritten by the next flush until they fill up.
+    */
+    void flush(write_txn& txn);
+
+    /**
+        Samples in [from, to), including the ones still buffered.
+    */
+    samples range(txn_base& txn, uint64_t series, int64_t from, int64_t to) const;
+
+    /**
+        Aggregates the samples in [from, to) into buckets of the given width, empty buckets are skipped.
+    */
+    std::vector<bucket> downsample(txn_base& txn, uint64_t series, int64_t from, int64_t to, int64_t width) const;
+
+    const dbi& db() const;
+
+private:
+    class block {
+    public:
+        void add(int64_t time, double value);
+        size_t size() const;
+        int64_t start() const;
+        int64_t last() const;
+        std::vector<unsigned char> encode() const;
+
+        /**
+            Decodes the samples of an encoded block in [from, to) and appends them to out.
+        */
+        static void decode(const MDB_val& data, int64_t from, int64_t to, samples& out);
+
+    private:
+        std::vector<unsigned char> times_;
+        std::vector<unsigned char> values_;
+        uint32_t count_ = 0;
+        int64_t start_ = 0;
+        int64_t last_time_ = 0;
+        int64_t last_delta_ = 0;
+        uint64_t last_bits_ = 0;
+    };
+
+    struct open_block {
+        block samples;
+        bool stored = false;
+    };
+
+    void write(write_txn& txn, uint64_t series, open_block& open);
+
+    /**
+        Saves the state of the series before txn first changes it, to restore if txn aborts.
+    */
+    void track(write_txn& txn, uint64_t series);
+
+    dbi db_;
+    size_t block_samples_;
+    std::map<uint64_t, open_block> open_;
+    std::optional<std::string> last_key_;
+
+    // state before the changes of the active transaction
+    MDB_txn *active_ = nullptr;
+    std::map<uint64_t, std::optional<open_block>> saved_;
+    std::optional<std::string> saved_last_key_;
+};
+
+}
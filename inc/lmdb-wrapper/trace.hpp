@@ -0,0 +1,199 @@
+#pragma once
+
+#include <lmdb.h>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    Process wide recorder of the operations issued through txn, dbi and
+    cursor, written to a compact binary trace that the replay tool runs
+    against a copy of the environment. Each record holds the start time and
+    duration, a small thread number, the operation with its LMDB flags and
+    result, the database, the key or its hash and the value size.
+
+    Recording is off until start is called, the hooks then cost one atomic
+    load. Records are encoded in a per-thread buffer and appended under a
+    lock. A replaced recorder is freed once no operation holds it.
+*/
+class trace_recorder {
+public:
+    enum class op : uint8_t {
+        dbi_open,
+        txn_begin,
+        txn_commit,
+        txn_abort,
+        txn_reset,
+        txn_renew,
+        get,
+        put,
+        del,
+        cursor_get
+    };
+
+    enum class key_mode : uint8_t {
+        none,
+        full,
+        hash
+    };
+
+    enum class status : uint8_t {
+        ok,
+        not_found,
+        error
+    };
+
+    /**
+        Added to the flags of txn_begin for nested transactions.
+    */
+    static constexpr unsigned int nested = 0x80000000u;
+
+    struct options {
+        /**
+            Keys are recorded in full for a faithful replay, or as 64 bit hashes
+            when they must not leave the machine.
+        */
+        key_mode keys = key_mode::full;
+        size_t buffer_size = 1 << 20;
+    };
+
+    /**
+        Starts recording to a new file, replacing the running recorder.
+    */
+    static void start(const std::string& path);
+
+    static void start(const std::string& path, const options& opts);
+
+    /**
+        Stops recording and flushes the trace.
+    */
+    static void stop();
+
+    static trace_recorder* active() {
+        return active_.load(std::memory_order_acquire);
+    }
+
+    /**
+        @return the running recorder, kept alive until release is called, or null
+    */
+    static trace_recorder* acquire() {
+        if (!active()) {
+            return nullptr;
+        }
+        // counted before loading again, a recorder replaced after that is not freed
+        holders_.fetch_add(1);
+        auto recorder = active_.load();
+        if (!recorder) {
+            release();
+        }
+        return recorder;
+    }
+
+    static void release() {
+        if (holders_.fetch_sub(1) == 1 && retired_.load()) {
+            reclaim();
+        }
+    }
+
+    static uint64_t now();
+
+    void record(op kind, int err, uint64_t start, MDB_dbi dbi, unsigned int flags, const MDB_val* key, size_t value_size);
+
+    /**
+        Records the name of a database handle, so that replay can open it.
+    */
+    static void describe(MDB_dbi dbi, const char* name, unsigned int flags);
+
+private:
+    trace_recorder(const std::string& path, const options& opts);
+
+    void flush();
+    void close();
+
+    /**
+        Frees the replaced recorders if no operation holds one.
+    */
+    static void reclaim();
+
+    static inline std::atomic<trace_recorder*> active_{nullptr};
+    static inline std::atomic<size_t> holders_{0};
+    static inline std::atomic<bool> retired_{false};
+
+    options options_;
+    uint64_t origin_;
+    std::mutex mutex_;
+    std::ofstream out_;
+    std::vector<unsigned char> buffer_;
+    bool closed_;
+};
+
+/**
+    Times one operation and records it when done, if a recorder is running.
+*/
+class trace_scope {
+public:
+    trace_scope(trace_recorder::op kind, MDB_dbi dbi = 0, unsigned int flags = 0):
+        recorder_{trace_recorder::acquire()}, kind_{kind}, dbi_{dbi}, flags_{flags}, start_{recorder_? trace_recorder::now() : 0} {
+
+    }
+
+    ~trace_scope() {
+        if (recorder_) {
+            trace_recorder::release();
+        }
+    }
+
+    trace_scope(const trace_scope&) = delete;
+    trace_scope& operator=(const trace_scope&) = delete;
+
+    void done(int err, const MDB_val* key = nullptr, size_t value_size = 0) {
+        if (recorder_) {
+            recorder_->record(kind_, err, start_, dbi_, flags_, key, value_size);
+        }
+    }
+
+private:
+    trace_recorder *recorder_;
+    trace_recorder::op kind_;
+    MDB_dbi dbi_;
+    unsigned int flags_;
+    uint64_t start_;
+};
+
+/**
+    One record of a trace file.
+*/
+struct trace_record {
+    trace_recorder::op kind;
+    trace_recorder::status result;
+    uint32_t thread;
+    uint64_t start;
+    uint64_t duration;
+    MDB_dbi dbi;
+    unsigned int flags;
+    trace_recorder::key_mode keys;
+    std::string key;
+    uint64_t key_hash;
+    size_t value_size;
+};
+
+class trace_reader {
+public:
+    trace_reader(const std::string& path);
+
+    /**
+        @return the next record, nothing at the end of the trace
+    */
+    std::optional<trace_record> next();
+
+private:
+    std::ifstream in_;
+};
+
+}
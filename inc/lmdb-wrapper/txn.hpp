@@ -2,10 +2,17 @@
 
 #include "lmdb-wrapper/env.hpp"
 #include "lmdb-wrapper/dbi.hpp"
+#include "lmdb-wrapper/trace.hpp"
+#include "lmdb-wrapper/reader_monitor.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
 
 namespace lmdb {
 
 class read_txn;
+class change_log;
 
 class txn_base {
 public:
@@ -50,7 +57,18 @@ public:
     MDB_env* env() const;
     MDB_txn* handle() const override;
 
+    /**
+        Transaction id, for a write transaction the id it commits as.
+    */
+    uint64_t id() const;
+
 protected:
+    /**
+        Lets the reader monitor of the env know where read transactions come from.
+    */
+    void began() const;
+    void ending() const;
+
     MDB_txn *txn_;
 };
 
@@ -79,27 +97,81 @@ public:
     write_txn& operator=(const write_txn&) = delete;
 
     write_txn(write_txn&&) = default;
-    write_txn& operator=(write_txn&&) = default;
+    write_txn& operator=(write_txn&&);
 
-    ~write_txn() = default;
+    /**
+        Runs the end callbacks as aborted if the transaction is still open.
+    */
+    ~write_txn();
 
     write_txn nested_write();
 
+    /**
+        Calls f once the transaction ends, with true if it committed. When a
+        transaction from nested_write commits its callbacks pass to the parent.
+    */
+    write_txn& on_end(std::function<void(bool)> f);
+
+    /**
+        Records every following put and del of this transaction in the log.
+        Transactions from nested_write log to it as well, in their own
+        transaction, so their records are dropped if they abort.
+    */
+    write_txn& log_changes(change_log& log);
+
+    /**
+        Commits, wakes the readers of the change log, counts the commit for
+        the durability policy of the env, if any, and lets its key filters
+        know the commit went through here.
+    */
+    write_txn& commit();
+
+    write_txn& abort();
+
     template <class T, class K>
     write_txn& put(const dbi& db, const K& key, const T& value, unsigned int flags) {
         db.template put<T>(txn_, key, value, flags);
+        if (log_) {
+            log_put(db, value::pack(key));
+        }
         return *this;
     }
 
     template <class T, class K>
     write_txn& del(const dbi& db, const K& key, const T& value) {
+        if (db.template del<T>(txn_, key, value) && log_) {
+            log_del(db, value::pack(key));
+        }
         return *this;
     }
 
     template <class K>
     write_txn& del(const dbi& db, const K& key) {
+        if (db.del(txn_, key) && log_) {
+            log_del(db, value::pack(key));
+        }
         return *this;
     }
+
+    /**
+        Records a put made without this class, e.g. with mdb_put, if the
+        transaction logs changes.
+    */
+    void log_put(const dbi& db, const MDB_val& key);
+
+    /**
+        Records a delete made without this class, if the transaction logs changes.
+    */
+    void log_del(const dbi& db, const MDB_val& key);
+
+private:
+    void ended(bool committed);
+
+    change_log *log_ = nullptr;
+    uint32_t seq_ = 0;
+    bool nested_ = false;
+    write_txn *parent_ = nullptr;
+    std::vector<std::function<void(bool)>> on_end_;
 };
 
 template <class Impl>
@@ -109,13 +181,21 @@ txn<Impl>::txn(MDB_env* env, unsigned int flags):txn(env, nullptr, flags) {
 
 template <class Impl>
 txn<Impl>::txn(MDB_env* env, MDB_txn* parent, unsigned int flags) {
-    mdb_txn_begin(env, parent, flags, &txn_);
+    trace_scope trace(trace_recorder::op::txn_begin, 0, parent? flags | trace_recorder::nested : flags);
+    int err = mdb_txn_begin(env, parent, flags, &txn_);
+    trace.done(err);
+    if (!err) {
+        began();
+    }
 }
 
 template <class Impl>
 txn<Impl>::~txn() {
     if (txn_) {
+        ending();
+        trace_scope trace(trace_recorder::op::txn_abort);
         mdb_txn_abort(txn_);
+        trace.done(0);
         txn_ = nullptr;
     }
 }
@@ -128,7 +208,10 @@ txn<Impl>::txn(txn&& other):txn_{other.txn_} {
 template <class Impl>
 txn<Impl>& txn<Impl>::operator=(txn&& other) {
     if (txn_) {
+        ending();
+        trace_scope trace(trace_recorder::op::txn_abort);
         mdb_txn_abort(txn_);
+        trace.done(0);
     }
     txn_ = other.txn_;
     other.txn_ = nullptr;
@@ -137,7 +220,12 @@ txn<Impl>& txn<Impl>::operator=(txn&& other) {
 
 template <class Impl>
 Impl& txn<Impl>::commit() {
+    ending();
+    trace_scope trace(trace_recorder::op::txn_commit);
     auto err = mdb_txn_commit(txn_);
+    trace.done(err);
+    // a failed commit aborts the transaction as well
+    txn_ = nullptr;
     switch (err) {
         case 0: break;
         case EINVAL: throw std::runtime_error("invalid transaction");
@@ -146,28 +234,35 @@ Impl& txn<Impl>::commit() {
         case ENOMEM: throw std::runtime_error("out of memory");
         default: throw std::runtime_error("failed to commit transaction");
     }
-    txn_ = nullptr;
     return static_cast<Impl&>(*this);
 }
 
 template <class Impl>
 Impl& txn<Impl>::abort() {
+    ending();
+    trace_scope trace(trace_recorder::op::txn_abort);
     mdb_txn_abort(txn_);
+    trace.done(0);
     txn_ = nullptr;
     return static_cast<Impl&>(*this);
 }
 
 template <class Impl>
 Impl& txn<Impl>::reset() {
+    ending();
+    trace_scope trace(trace_recorder::op::txn_reset);
     mdb_txn_reset(txn_);
+    trace.done(0);
     return static_cast<Impl&>(*this);
 }
 
 template <class Impl>
 Impl& txn<Impl>::renew() {
+    trace_scope trace(trace_recorder::op::txn_renew);
     auto err = mdb_txn_renew(txn_);
+    trace.done(err);
     switch (err) {
-        case 0: break;
+        case 0: began(); break;
         case MDB_PANIC: throw std::runtime_error("fatal error");
         case EINVAL: throw std::runtime_error("invalid transaction");
         default: throw std::runtime_error("failed to renew transaction");
@@ -175,11 +270,32 @@ Impl& txn<Impl>::renew() {
     return static_cast<Impl&>(*this);
 }
 
+template <class Impl>
+void txn<Impl>::began() const {
+    if constexpr ((Impl::flags & MDB_RDONLY) != 0) {
+        reader_monitor::began(txn_);
+    }
+}
+
+template <class Impl>
+void txn<Impl>::ending() const {
+    if constexpr ((Impl::flags & MDB_RDONLY) != 0) {
+        if (txn_) {
+            reader_monitor::ended(txn_);
+        }
+    }
+}
+
 template <class Impl>
 MDB_env* txn<Impl>::env() const {
     return mdb_txn_env(txn_);
 }
 
+template <class Impl>
+uint64_t txn<Impl>::id() const {
+    return mdb_txn_id(txn_);
+}
+
 template <class Impl>
 MDB_txn* txn<Impl>::handle() const {
     return txn_;
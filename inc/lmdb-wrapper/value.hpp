@@ -1,8 +1,12 @@
 #pragma once
 
 #include <lmdb.h>
+#include <algorithm>
 #include <cstring>
+#include <memory_resource>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 #include <iostream>
 
@@ -37,6 +41,36 @@ inline std::string value::unpack<std::string>(const MDB_val& val) {
     return std::string(static_cast<char*>(val.mv_data), val.mv_size);
 }
 
+template <>
+inline MDB_val value::pack<std::pmr::string>(const std::pmr::string& val) {
+    MDB_val result;
+    result.mv_size = val.size();
+    result.mv_data = const_cast<char*>(val.data());
+    return result;
+}
+
+template <>
+inline std::pmr::string value::unpack<std::pmr::string>(const MDB_val& val) {
+    return std::pmr::string(static_cast<char*>(val.mv_data), val.mv_size);
+}
+
+template <>
+inline MDB_val value::pack<std::string_view>(const std::string_view& val) {
+    MDB_val result;
+    result.mv_size = val.size();
+    result.mv_data = const_cast<char*>(val.data());
+    return result;
+}
+
+/**
+    The view points into the memory map and is only valid until the
+    transaction that produced it ends or the entry is modified.
+*/
+template <>
+inline std::string_view value::unpack<std::string_view>(const MDB_val& val) {
+    return std::string_view(static_cast<const char*>(val.mv_data), val.mv_size);
+}
+
 template <class T>
 class object {
 public:
@@ -51,6 +85,14 @@ public:
         return value::unpack<T>(val_); 
     }
 
+    /**
+        Decodes the value allocating from the given resource. Types that
+        do not allocate ignore it.
+    */
+    T value(std::pmr::memory_resource*) const {
+        return value::unpack<T>(val_);
+    }
+
     MDB_val* data() {
         return &val_;
     }
@@ -61,9 +103,42 @@ private:
 
 
 template <>
-class object<std::vector<std::string>> {
+class object<std::pmr::string> {
+public:
+    object(const std::pmr::string& val) {
+        val_ = value::pack<std::pmr::string>(val);
+    }
+
+    object(MDB_val val):val_{val} {
+    }
+
+    std::pmr::string value() const {
+        return value(std::pmr::get_default_resource());
+    }
+
+    std::pmr::string value(std::pmr::memory_resource* resource) const {
+        return std::pmr::string(static_cast<const char*>(val_.mv_data), val_.mv_size, resource);
+    }
+
+    MDB_val* data() {
+        return &val_;
+    }
+
+private:
+    MDB_val val_;
+};
+
+
+/**
+    Stores a list of strings as consecutive null terminated entries.
+    List is any sequence container of std::string, std::pmr::string or
+    std::string_view; pmr containers allocate from the resource passed to
+    value(), string_view elements point into the memory map.
+*/
+template <class List>
+class string_list_object {
 public:
-    object(const std::vector<std::string>& val) {
+    string_list_object(const List& val) {
         val_.mv_size = 0;
         for (const auto& s : val) {
             val_.mv_size += s.size() + 1;
@@ -76,13 +151,18 @@ public:
         val_.mv_data = data_.data();
     }
 
-    object(MDB_val val):val_{val} {
+    string_list_object(MDB_val val):val_{val} {
     }
 
-    std::vector<std::string> value() const {
-        size_t index = 0;
-        std::vector<std::string> result;
+    List value() const {
+        return value(std::pmr::get_default_resource());
+    }
+
+    List value(std::pmr::memory_resource* resource) const {
+        List result = make_list(resource);
         auto ptr = static_cast<const char*>(val_.mv_data);
+        result.reserve(std::count(ptr, ptr + val_.mv_size, '\0'));
+        size_t index = 0;
         for (size_t i = 0; i < val_.mv_size; ++i) {
             if (ptr[i] == '\0') {
                 result.emplace_back(ptr + index, i - index);
@@ -95,11 +175,44 @@ public:
     MDB_val* data() {
         return &val_;
     }
+
 private:
+    static List make_list(std::pmr::memory_resource* resource) {
+        if constexpr (std::is_constructible_v<List, std::pmr::memory_resource*>) {
+            return List(resource);
+        } else {
+            return List();
+        }
+    }
+
     MDB_val val_;
     std::vector<char> data_;
 };
 
 
-}
+template <>
+class object<std::vector<std::string>> : public string_list_object<std::vector<std::string>> {
+public:
+    using string_list_object::string_list_object;
+};
 
+template <>
+class object<std::pmr::vector<std::pmr::string>> : public string_list_object<std::pmr::vector<std::pmr::string>> {
+public:
+    using string_list_object::string_list_object;
+};
+
+template <>
+class object<std::vector<std::string_view>> : public string_list_object<std::vector<std::string_view>> {
+public:
+    using string_list_object::string_list_object;
+};
+
+template <>
+class object<std::pmr::vector<std::string_view>> : public string_list_object<std::pmr::vector<std::string_view>> {
+public:
+    using string_list_object::string_list_object;
+};
+
+
+}
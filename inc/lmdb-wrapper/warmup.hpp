@@ -0,0 +1,98 @@
+#pragma once
+
+#include <lmdb.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    Page cache warm-up done by env::factory::open before it returns.
+*/
+struct warmup_options {
+    /**
+        Prefetch the regions of the saved page profile.
+    */
+    bool profile = true;
+    /**
+        Save a new profile of the resident pages when the environment closes,
+        off by default since it scans the whole map with mincore and writes
+        the profile file on every close.
+    */
+    bool record_on_close = false;
+    /**
+        Databases whose branch pages are preloaded first, an empty name stands for the main database.
+    */
+    std::vector<std::string> branch_dbs;
+    /**
+        Upper bound of the data read ahead.
+    */
+    size_t max_bytes = size_t(1) << 30;
+    unsigned int threads = 4;
+    /**
+        Profile file, empty for the default next to the data file.
+    */
+    std::string path;
+};
+
+/**
+    Regions of the data file that were resident in the page cache, as seen by
+    mincore on the memory map.
+*/
+class page_profile {
+public:
+    struct extent {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    /**
+        Profiles the pages of the map that are resident right now, runs of
+        resident pages separated by small gaps are merged.
+    */
+    static page_profile record(MDB_env* env);
+
+    static std::optional<page_profile> load(const std::string& path);
+
+    static std::string default_path(MDB_env* env);
+
+    void save(const std::string& path) const;
+
+    /**
+        Reads the profiled regions into the page cache from several threads,
+        extents past the end of the data file are skipped.
+        @return bytes read ahead
+    */
+    size_t prefetch(MDB_env* env, size_t max_bytes, unsigned int threads) const;
+
+    const std::vector<extent>& extents() const;
+
+    size_t bytes() const;
+
+private:
+    std::vector<extent> extents_;
+};
+
+class warmup {
+public:
+    /**
+        Preloads the branch pages of the databases, then prefetches the
+        profile, within the budget. Failures only skip the step, they are not
+        reported.
+    */
+    static void run(MDB_env* env, const warmup_options& opts);
+
+    /**
+        Reads every branch page of a database level by level, asking for each
+        level at once. Walks the on-disk page format of LMDB 0.9 in a read
+        transaction, leaf pages are not touched; nothing is read if the
+        library is not LMDB 0.9 or the meta pages have another magic or
+        version.
+        @return bytes of the branch pages, 0 if the database does not exist
+    */
+    static size_t preload_branches(MDB_env* env, const std::string& name, size_t max_bytes);
+};
+
+}
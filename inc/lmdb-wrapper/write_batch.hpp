@@ -0,0 +1,309 @@
+#pragma once
+
+#include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/txn.hpp"
+#include "lmdb-wrapper/key_range.hpp"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace lmdb {
+
+/**
+    Thrown by write_batch::commit when data read by the batch changed after its snapshot.
+*/
+class write_conflict : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+template <class K, class V>
+class batch_iterator;
+
+/**
+    Buffers puts and deletes in memory on top of a read snapshot, so the
+    write lock is only taken by commit. Reads see the buffered writes first.
+    commit validates the keys that were read: if any transaction committed
+    since the snapshot, each key read must still have the value that was seen,
+    and a scan requires that nothing was committed at all. On success the
+    buffered mutations are applied in key order.
+    Databases with duplicate keys are not supported.
+*/
+class write_batch {
+public:
+    write_batch(const env& e);
+
+    write_batch(const write_batch&) = delete;
+    write_batch& operator=(const write_batch&) = delete;
+
+    template <class T, class K>
+    write_batch& put(const dbi& db, const K& key, const T& value, unsigned int flags = 0) {
+        object<T> obj(value);
+        const MDB_val* data = obj.data();
+        writes_[make_key(db, value::pack(key))] = mutation{std::string(static_cast<const char*>(data->mv_data), data->mv_size), flags};
+        return *this;
+    }
+
+    template <class K>
+    write_batch& del(const dbi& db, const K& key) {
+        writes_[make_key(db, value::pack(key))] = mutation{std::nullopt, 0};
+        return *this;
+    }
+
+    template <class T, class K>
+    T get(const dbi& db, const K& key) {
+        auto data = lookup(db, value::pack(key));
+        if (!data) {
+            throw std::runtime_error("key does not exist");
+        }
+        object<T> obj(*data);
+        return obj.value();
+    }
+
+    template <class T, class K>
+    T get(const dbi& db, const K& key, const T& default_value) {
+        auto data = lookup(db, value::pack(key));
+        if (!data) {
+            return default_value;
+        }
+        object<T> obj(*data);
+        return obj.value();
+    }
+
+    /**
+        Iterates the snapshot overlaid with the buffered writes of the database, forward ranges only.
+    */
+    template <class K, class V>
+    batch_iterator<K, V> scan(const dbi& db, const key_range& range = key_range::all());
+
+    size_t size() const;
+
+    /**
+        Records the mutations applied by commit in the log, see write_txn::log_changes.
+    */
+    write_batch& log_changes(change_log& log);
+
+    /**
+        Releases the snapshot, then validates and applies the batch in one write
+        transaction. Whether it succeeds or throws, the batch is then empty
+        and reads a new snapshot, so after a write_conflict the reads and
+        writes can be made again with the same batch.
+        @throws write_conflict if validation fails, nothing is written in that case
+    */
+    void commit();
+
+private:
+    template <class K, class V>
+    friend class batch_iterator;
+
+    typedef std::pair<MDB_dbi, std::string> key_t;
+
+    struct mutation {
+        std::optional<std::string> value;
+        unsigned int flags;
+    };
+
+    static key_t make_key(const dbi& db, const MDB_val& key);
+
+    std::optional<MDB_val> lookup(const dbi& db, const MDB_val& key);
+
+    void apply();
+
+    /**
+        Drops the buffered reads and writes and takes a new snapshot.
+    */
+    void restart();
+
+    env env_;
+    read_txn snapshot_;
+    size_t snapshot_id_;
+    std::map<key_t, mutation> writes_;
+    std::map<key_t, std::optional<std::string>> reads_;
+    bool scanned_;
+    change_log *log_ = nullptr;
+};
+
+template <class K, class V>
+class batch_iterator {
+public:
+    batch_iterator();
+
+    batch_iterator(MDB_txn* txn, const dbi& db, const key_range& range, std::vector<std::pair<std::string, std::optional<std::string>>> buffered);
+
+    batch_iterator(batch_iterator&&) = default;
+    batch_iterator& operator=(batch_iterator&&) = default;
+
+    const std::pair<K, V>& operator*() const;
+
+    const std::pair<K, V>* operator->() const;
+
+    batch_iterator& operator++();
+
+    bool operator==(const batch_iterator& it) const;
+
+    bool operator!=(const batch_iterator& it) const;
+
+private:
+    void settle();
+
+    MDB_txn *txn_;
+    MDB_dbi dbi_;
+    key_range range_;
+    std::unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> cursor_;
+    std::optional<std::pair<MDB_val, MDB_val>> stored_;
+    std::vector<std::pair<std::string, std::optional<std::string>>> buffered_;
+    size_t index_;
+    bool from_buffer_;
+    std::optional<std::pair<K, V>> current_;
+};
+
+
+template <class K, class V>
+batch_iterator<K, V> write_batch::scan(const dbi& db, const key_range& range) {
+    if (range.is_reverse()) {
+        throw std::runtime_error("reverse scans are not supported");
+    }
+    scanned_ = true;
+
+    std::vector<std::pair<std::string, std::optional<std::string>>> buffered;
+    auto it = writes_.lower_bound(key_t(db.handle(), std::string()));
+    for (; it != writes_.end() && it->first.first == db.handle(); ++it) {
+        MDB_val key{it->first.second.size(), const_cast<char*>(it->first.second.data())};
+        if (range.contains(snapshot_.handle(), db.handle(), key)) {
+            buffered.emplace_back(it->first.second, it->second.value);
+        }
+    }
+    // the buffer is sorted bytewise, the database may use another ordering
+    std::sort(buffered.begin(), buffered.end(), [&](const auto& x, const auto& y) {
+        MDB_val a{x.first.size(), const_cast<char*>(x.first.data())};
+        MDB_val b{y.first.size(), const_cast<char*>(y.first.data())};
+        return mdb_cmp(snapshot_.handle(), db.handle(), &a, &b) < 0;
+    });
+    return batch_iterator<K, V>(snapshot_.handle(), db, range, std::move(buffered));
+}
+
+
+template <class K, class V>
+batch_iterator<K, V>::batch_iterator():txn_{nullptr}, dbi_{0}, cursor_{nullptr, mdb_cursor_close}, index_{0}, from_buffer_{false} {
+
+}
+
+template <class K, class V>
+batch_iterator<K, V>::batch_iterator(MDB_txn* txn, const dbi& db, const key_range& range, std::vector<std::pair<std::string, std::optional<std::string>>> buffered):
+    txn_{txn}, dbi_{db.handle()}, range_{range}, cursor_{nullptr, mdb_cursor_close}, buffered_{std::move(buffered)}, index_{0}, from_buffer_{false} {
+
+    MDB_cursor *cur;
+    if (mdb_cursor_open(txn_, dbi_, &cur)) {
+        throw std::runtime_error("failed to open cursor");
+    }
+    cursor_.reset(cur);
+    MDB_val key, data;
+    int err = range_.first(cursor_.get(), key, data);
+    if (!err) {
+        stored_ = std::make_pair(key, data);
+    } else if (err != MDB_NOTFOUND) {
+        throw std::runtime_error("cursor error");
+    }
+    settle();
+}
+
+template <class K, class V>
+const std::pair<K, V>& batch_iterator<K, V>::operator*() const {
+    if (!current_) {
+        throw std::runtime_error("invalid iterator");
+    }
+    return *current_;
+}
+
+template <class K, class V>
+const std::pair<K, V>* batch_iterator<K, V>::operator->() const {
+    return &(**this);
+}
+
+template <class K, class V>
+batch_iterator<K, V>& batch_iterator<K, V>::operator++() {
+    if (!current_) {
+        return *this;
+    }
+    if (from_buffer_) {
+        ++index_;
+    } else {
+        MDB_val key, data;
+        int err = range_.next(cursor_.get(), key, data);
+        if (!err) {
+            stored_ = std::make_pair(key, data);
+        } else if (err == MDB_NOTFOUND) {
+            stored_.reset();
+        } else {
+            throw std::runtime_error("cursor error");
+        }
+    }
+    settle();
+    return *this;
+}
+
+template <class K, class V>
+bool batch_iterator<K, V>::operator==(const batch_iterator<K, V>& it) const {
+    if (!current_ || !it.current_) {
+        return !current_ && !it.current_;
+    }
+    return current_->first == it.current_->first;
+}
+
+template <class K, class V>
+bool batch_iterator<K, V>::operator!=(const batch_iterator<K, V>& it) const {
+    return ! (*this == it);
+}
+
+template <class K, class V>
+void batch_iterator<K, V>::settle() {
+    current_.reset();
+    while (stored_ || index_ < buffered_.size()) {
+        int cmp = 1;
+        if (index_ < buffered_.size() && stored_) {
+            const auto& b = buffered_[index_].first;
+            MDB_val key{b.size(), const_cast<char*>(b.data())};
+            cmp = mdb_cmp(txn_, dbi_, &stored_->first, &key);
+        } else if (stored_) {
+            cmp = -1;
+        }
+
+        if (cmp < 0) {
+            from_buffer_ = false;
+            object<K> k(stored_->first);
+            object<V> v(stored_->second);
+            current_ = std::make_pair(k.value(), v.value());
+            return;
+        }
+        if (!cmp) {
+            // the buffered write replaces the stored entry
+            MDB_val key, data;
+            int err = range_.next(cursor_.get(), key, data);
+            if (!err) {
+                stored_ = std::make_pair(key, data);
+            } else if (err == MDB_NOTFOUND) {
+                stored_.reset();
+            } else {
+                throw std::runtime_error("cursor error");
+            }
+        }
+        const auto& entry = buffered_[index_];
+        if (!entry.second) {
+            ++index_;
+            continue;
+        }
+        from_buffer_ = true;
+        object<K> k(MDB_val{entry.first.size(), const_cast<char*>(entry.first.data())});
+        object<V> v(MDB_val{entry.second->size(), const_cast<char*>(entry.second->data())});
+        current_ = std::make_pair(k.value(), v.value());
+        return;
+    }
+}
+
+}
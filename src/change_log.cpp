@@ -0,0 +1,306 @@
+#include "lmdb-wrapper/change_log.hpp"
+#include "lmdb-wrapper/dbi_registry.hpp"
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace lmdb {
+
+namespace {
+
+constexpr size_t key_size = 12;
+// kind, time in ms, length of the db name, followed by the name and the key
+constexpr size_t header_size = 1 + sizeof(int64_t) + sizeof(uint16_t);
+
+void encode_position(const change::position& pos, unsigned char* out) {
+    for (int i = 0; i < 8; ++i) {
+        out[i] = static_cast<unsigned char>(pos.txnid >> (56 - 8 * i));
+    }
+    for (int i = 0; i < 4; ++i) {
+        out[8 + i] = static_cast<unsigned char>(pos.seq >> (24 - 8 * i));
+    }
+}
+
+change::position decode_position(const MDB_val& key) {
+    change::position pos;
+    if (key.mv_size != key_size) {
+        throw std::runtime_error("corrupted change log");
+    }
+    auto in = static_cast<const unsigned char*>(key.mv_data);
+    for (int i = 0; i < 8; ++i) {
+        pos.txnid = (pos.txnid << 8) | in[i];
+    }
+    for (int i = 0; i < 4; ++i) {
+        pos.seq = (pos.seq << 8) | in[8 + i];
+    }
+    return pos;
+}
+
+int64_t record_time(const MDB_val& data) {
+    int64_t ms;
+    std::memcpy(&ms, static_cast<const char*>(data.mv_data) + 1, sizeof(ms));
+    return ms;
+}
+
+change decode(const MDB_val& key, const MDB_val& data) {
+    if (data.mv_size < header_size) {
+        throw std::runtime_error("corrupted change log");
+    }
+    auto in = static_cast<const char*>(data.mv_data);
+    uint16_t name_size;
+    std::memcpy(&name_size, in + 1 + sizeof(int64_t), sizeof(name_size));
+    if (data.mv_size < header_size + name_size) {
+        throw std::runtime_error("corrupted change log");
+    }
+    change result;
+    result.pos = decode_position(key);
+    result.kind = static_cast<change::op>(in[0]);
+    result.time = std::chrono::system_clock::time_point(std::chrono::milliseconds(record_time(data)));
+    result.db.assign(in + header_size, name_size);
+    result.key.assign(in + header_size + name_size, data.mv_size - header_size - name_size);
+    return result;
+}
+
+#ifdef __linux__
+std::atomic<uint32_t>* map_counter(MDB_env* env) {
+    const char *path;
+    unsigned int flags;
+    if (mdb_env_get_path(env, &path) || mdb_env_get_flags(env, &flags)) {
+        return nullptr;
+    }
+    std::string file = (flags & MDB_NOSUBDIR)? std::string(path) + "-changes" : std::string(path) + "/changes.notify";
+    int fd = open(file.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return nullptr;
+    }
+    void *ptr = MAP_FAILED;
+    struct stat st;
+    if (!fstat(fd, &st) && (st.st_size >= long(sizeof(uint32_t)) || !ftruncate(fd, sizeof(uint32_t)))) {
+        ptr = mmap(nullptr, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    return ptr == MAP_FAILED? nullptr : static_cast<std::atomic<uint32_t>*>(ptr);
+}
+#endif
+
+class cursor_guard {
+public:
+    cursor_guard(MDB_txn* txn, MDB_dbi db) {
+        if (mdb_cursor_open(txn, db, &cursor_)) {
+            throw std::runtime_error("failed to open cursor");
+        }
+    }
+    ~cursor_guard() {
+        mdb_cursor_close(cursor_);
+    }
+    MDB_cursor* get() const {
+        return cursor_;
+    }
+private:
+    MDB_cursor *cursor_;
+};
+
+}
+
+change_log::change_log(const env& e, const std::string& name):env_{e}, counter_{nullptr}, local_counter_{0} {
+    write_txn txn(env_.handle());
+    db_ = txn.db().set(dbi::flags::create).open(name);
+    txn.commit();
+#ifdef __linux__
+    counter_ = map_counter(env_.handle());
+#endif
+}
+
+change_log::~change_log() {
+#ifdef __linux__
+    if (counter_) {
+        munmap(counter_, sizeof(uint32_t));
+    }
+#endif
+}
+
+const dbi& change_log::db() const {
+    return db_;
+}
+
+MDB_env* change_log::env_handle() const {
+    return env_.handle();
+}
+
+void change_log::append(MDB_txn* txn, uint32_t seq, change::op kind, const dbi& db, const MDB_val& key) {
+    unsigned char k[key_size];
+    encode_position(change::position{mdb_txn_id(txn), seq}, k);
+    MDB_val mdb_key{key_size, k};
+
+    // handles are local to the process, the name is what a reader can open
+    auto registry = dbi_registry::of(mdb_txn_env(txn));
+    auto name = registry? registry->name(db.handle()) : std::nullopt;
+    if (!name) {
+        throw std::runtime_error("db of the change has no known name");
+    }
+    if (name->size() > UINT16_MAX) {
+        throw std::runtime_error("db name too long for the change log");
+    }
+    uint16_t name_size = static_cast<uint16_t>(name->size());
+    int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    MDB_val data{header_size + name_size + key.mv_size, nullptr};
+    if (mdb_put(txn, db_.handle(), &mdb_key, &data, MDB_APPEND | MDB_RESERVE)) {
+        throw std::runtime_error("failed to append change");
+    }
+    dbi::filter_put(txn, db_.handle(), mdb_key);
+    auto out = static_cast<char*>(data.mv_data);
+    out[0] = static_cast<char>(kind);
+    std::memcpy(out + 1, &ms, sizeof(ms));
+    std::memcpy(out + 1 + sizeof(ms), &name_size, sizeof(name_size));
+    std::memcpy(out + header_size, name->data(), name_size);
+    std::memcpy(out + header_size + name_size, key.mv_data, key.mv_size);
+}
+
+uint32_t change_log::sequence() const {
+    return (counter_? *counter_ : local_counter_).load();
+}
+
+void change_log::notify() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        local_counter_.fetch_add(1);
+    }
+    cv_.notify_all();
+#ifdef __linux__
+    if (counter_) {
+        counter_->fetch_add(1);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(counter_), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+#endif
+}
+
+bool change_log::wait(uint32_t seen, std::chrono::milliseconds timeout) const {
+#ifdef __linux__
+    if (counter_) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (counter_->load() == seen) {
+            auto left = deadline - std::chrono::steady_clock::now();
+            if (left <= std::chrono::steady_clock::duration::zero()) {
+                return false;
+            }
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+            struct timespec ts{static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000)};
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(counter_), FUTEX_WAIT, seen, &ts, nullptr, 0);
+        }
+        return true;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_for(lock, timeout, [&] { return local_counter_.load() != seen; });
+}
+
+size_t change_log::trim(write_txn& txn, const retention& policy) const {
+    MDB_stat stat;
+    if (mdb_stat(txn.handle(), db_.handle(), &stat)) {
+        throw std::runtime_error("failed to stat change log");
+    }
+    size_t excess = (policy.max_entries && stat.ms_entries > policy.max_entries)? stat.ms_entries - policy.max_entries : 0;
+    int64_t oldest = 0;
+    if (policy.max_age.count()) {
+        oldest = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch() - policy.max_age).count();
+    }
+
+    cursor_guard cur(txn.handle(), db_.handle());
+    size_t count = 0;
+    MDB_val key, data;
+    int err = mdb_cursor_get(cur.get(), &key, &data, MDB_FIRST);
+    while (!err && (count < excess || record_time(data) < oldest)) {
+        if (mdb_cursor_del(cur.get(), 0)) {
+            throw std::runtime_error("failed to trim change log");
+        }
+        dbi::filter_del(txn.handle(), db_.handle());
+        ++count;
+        err = mdb_cursor_get(cur.get(), &key, &data, MDB_NEXT);
+    }
+    return count;
+}
+
+size_t change_log::trim(write_txn& txn, const change::position& before) const {
+    unsigned char bound[key_size];
+    encode_position(before, bound);
+
+    cursor_guard cur(txn.handle(), db_.handle());
+    size_t count = 0;
+    MDB_val key, data;
+    int err = mdb_cursor_get(cur.get(), &key, &data, MDB_FIRST);
+    while (!err && std::memcmp(key.mv_data, bound, key_size) < 0) {
+        if (mdb_cursor_del(cur.get(), 0)) {
+            throw std::runtime_error("failed to trim change log");
+        }
+        dbi::filter_del(txn.handle(), db_.handle());
+        ++count;
+        err = mdb_cursor_get(cur.get(), &key, &data, MDB_NEXT);
+    }
+    return count;
+}
+
+
+change_reader::change_reader(const change_log& log, change::position from):log_{&log}, pos_{from} {
+
+}
+
+std::vector<change> change_reader::poll(size_t max) {
+    std::vector<change> result;
+    read_txn txn(log_->env_handle());
+    cursor_guard cur(txn.handle(), log_->db().handle());
+
+    unsigned char k[key_size];
+    encode_position(pos_, k);
+    MDB_val key{key_size, k}, data;
+    int err = mdb_cursor_get(cur.get(), &key, &data, MDB_SET_RANGE);
+    while (!err && result.size() < max) {
+        result.push_back(decode(key, data));
+        err = mdb_cursor_get(cur.get(), &key, &data, MDB_NEXT);
+    }
+    if (err && err != MDB_NOTFOUND) {
+        throw std::runtime_error("cursor error");
+    }
+    if (!result.empty()) {
+        pos_ = result.back().pos;
+        ++pos_.seq;
+    }
+    return result;
+}
+
+std::vector<change> change_reader::wait(size_t max, std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+        uint32_t seen = log_->sequence();
+        auto result = poll(max);
+        if (!result.empty()) {
+            return result;
+        }
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0 || !log_->wait(seen, left)) {
+            return result;
+        }
+    }
+}
+
+change::position change_reader::position() const {
+    return pos_;
+}
+
+void change_reader::seek(const change::position& pos) {
+    pos_ = pos;
+}
+
+}
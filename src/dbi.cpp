@@ -1,4 +1,5 @@
 #include "lmdb-wrapper/dbi.hpp"
+#include "lmdb-wrapper/dbi_registry.hpp"
 
 namespace lmdb {
 
@@ -6,6 +7,10 @@ dbi::dbi(MDB_txn* txn, const std::string& path, unsigned int flags) {
     auto err = mdb_dbi_open(txn, path.c_str(), flags, &dbi_);
     switch (err) {
         case 0:
+            trace_recorder::describe(dbi_, path.c_str(), flags);
+            if (auto registry = dbi_registry::of(mdb_txn_env(txn))) {
+                registry->named(dbi_, path);
+            }
             break;
         case MDB_NOTFOUND:
             throw std::runtime_error("db not found");
@@ -20,6 +25,10 @@ dbi::dbi(MDB_txn* txn, unsigned int flags) {
     auto err = mdb_dbi_open(txn, NULL, flags, &dbi_);
     switch (err) {
         case 0:
+            trace_recorder::describe(dbi_, nullptr, flags);
+            if (auto registry = dbi_registry::of(mdb_txn_env(txn))) {
+                registry->named(dbi_, std::string());
+            }
             break;
         case MDB_NOTFOUND:
             throw std::runtime_error("db not found");
@@ -30,11 +39,58 @@ dbi::dbi(MDB_txn* txn, unsigned int flags) {
     }
 }
 
+dbi::dbi(MDB_dbi handle):dbi_{handle} {
+
+}
+
 MDB_dbi dbi::handle() const {
     return dbi_;
 }
 
-dbi::factory::factory(MDB_txn* txn):txn_{txn}, flags_{0} {
+void dbi::set_compare(MDB_txn* txn, MDB_cmp_func* cmp) const {
+    if (mdb_set_compare(txn, dbi_, cmp)) {
+        throw std::runtime_error("failed to set compare function");
+    }
+}
+
+void dbi::set_dupsort(MDB_txn* txn, MDB_cmp_func* cmp) const {
+    if (mdb_set_dupsort(txn, dbi_, cmp)) {
+        throw std::runtime_error("failed to set dupsort function");
+    }
+}
+
+bool dbi::may_contain(MDB_txn* txn, MDB_dbi dbi, const MDB_val& key) {
+    auto registry = dbi_registry::of(mdb_txn_env(txn));
+    auto filter = registry? registry->filter(dbi) : nullptr;
+    if (!filter) {
+        return true;
+    }
+    MDB_envinfo info;
+    if (mdb_env_info(mdb_txn_env(txn), &info)) {
+        return true;
+    }
+    return filter->may_contain(key, registry->last_foreign(info.me_last_txnid));
+}
+
+void dbi::filter_put(MDB_txn* txn, MDB_dbi dbi, const MDB_val& key) {
+    auto registry = dbi_registry::of(mdb_txn_env(txn));
+    if (auto filter = registry? registry->filter(dbi) : nullptr) {
+        filter->add(key);
+    }
+}
+
+void dbi::filter_del(MDB_txn* txn, MDB_dbi dbi) {
+    auto registry = dbi_registry::of(mdb_txn_env(txn));
+    if (auto filter = registry? registry->filter(dbi) : nullptr) {
+        filter->removed();
+    }
+}
+
+int dbi::compare(MDB_txn* txn, const MDB_val& a, const MDB_val& b) const {
+    return mdb_cmp(txn, dbi_, &a, &b);
+}
+
+dbi::factory::factory(MDB_txn* txn):txn_{txn}, flags_{0}, compare_{nullptr}, dupsort_{nullptr} {
 
 }
 
@@ -53,12 +109,37 @@ dbi::factory& dbi::factory::unset_flags() {
     return *this;
 }
 
+dbi::factory& dbi::factory::set_compare(MDB_cmp_func* cmp) {
+    compare_ = cmp;
+    return *this;
+}
+
+dbi::factory& dbi::factory::set_dupsort(MDB_cmp_func* cmp) {
+    dupsort_ = cmp;
+    return *this;
+}
+
 dbi dbi::factory::open(const std::string& path) {
-    return dbi(txn_, path, flags_);
+    if (auto registry = dbi_registry::of(mdb_txn_env(txn_))) {
+        dbi result = registry->open(txn_, path, flags_, compare_, dupsort_);
+        trace_recorder::describe(result.handle(), path.c_str(), flags_);
+        return result;
+    }
+    return init(dbi(txn_, path, flags_));
 }
 
 dbi dbi::factory::open() {
-    return dbi(txn_, flags_);
+    return init(dbi(txn_, flags_));
+}
+
+dbi dbi::factory::init(dbi result) {
+    if (compare_) {
+        result.set_compare(txn_, compare_);
+    }
+    if (dupsort_) {
+        result.set_dupsort(txn_, dupsort_);
+    }
+    return result;
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,409 @@
+#include "lmdb-wrapper/dbi_registry.hpp"
+#include "lmdb-wrapper/env_context.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <future>
+
+namespace lmdb {
+
+namespace {
+
+// flags stored with a database
+constexpr unsigned int persistent_flags = MDB_REVERSEKEY | MDB_DUPSORT | MDB_INTEGERKEY | MDB_DUPFIXED | MDB_INTEGERDUP | MDB_REVERSEDUP;
+
+/**
+    Throws if an open database lacks the flags or has other comparators than asked for.
+    @return false if a comparator asked for is not installed yet
+*/
+bool matches(const dbi_registry::entry& e, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort) {
+    unsigned int wanted = flags & persistent_flags;
+    if (wanted && wanted != (e.flags & persistent_flags)) {
+        throw std::runtime_error("incompatible db flags");
+    }
+    if ((compare && e.compare && compare != e.compare) || (dupsort && e.dupsort && dupsort != e.dupsort)) {
+        throw std::runtime_error("incompatible db comparator");
+    }
+    return (!compare || e.compare) && (!dupsort || e.dupsort);
+}
+
+void check_open(int err) {
+    switch (err) {
+        case 0:
+            break;
+        case MDB_NOTFOUND:
+            throw std::runtime_error("db not found");
+        case MDB_DBS_FULL:
+            throw std::runtime_error("max dbs reached");
+        case MDB_INCOMPATIBLE:
+            throw std::runtime_error("incompatible db flags");
+        default:
+            throw std::runtime_error("failed to open dbi");
+    }
+}
+
+std::string side_file(MDB_env* env, const std::string& name) {
+    const char *path;
+    unsigned int flags;
+    if (mdb_env_get_path(env, &path) || mdb_env_get_flags(env, &flags)) {
+        throw std::runtime_error("invalid env");
+    }
+    return (flags & MDB_NOSUBDIR)? std::string(path) + "-" + name : std::string(path) + "/" + name;
+}
+
+/**
+    Runs f with the write lock of the environment held, or in a read
+    transaction if the environment is read only, on a thread without a
+    transaction of its own. f receives the last committed transaction id.
+*/
+template <class F>
+auto with_write_lock(MDB_env* env, F f) {
+    return std::async(std::launch::async, [&]() {
+        MDB_txn *txn;
+        bool locked = !mdb_txn_begin(env, nullptr, 0, &txn);
+        if (!locked && mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn)) {
+            throw std::runtime_error("failed to begin transaction");
+        }
+        uint64_t last = locked? mdb_txn_id(txn) - 1 : mdb_txn_id(txn);
+        try {
+            auto result = f(last);
+            mdb_txn_abort(txn);
+            return result;
+        } catch (...) {
+            mdb_txn_abort(txn);
+            throw;
+        }
+    }).get();
+}
+
+}
+
+dbi_registry::dbi_registry(MDB_env* env):
+    env_{env}, table_{std::make_shared<const table>()}, filters_{std::make_shared<const filter_table>()}, names_{std::make_shared<const name_table>()}, has_filters_{false}, last_commit_{0}, last_gap_{0}, in_flight_{0} {
+
+}
+
+dbi_registry::~dbi_registry() {
+    auto filters = std::atomic_load(&filters_);
+    if (filters->empty()) {
+        return;
+    }
+    for (const auto& [handle, f] : *filters) {
+        f->stop();
+    }
+    try {
+        with_write_lock(env_, [&](uint64_t last) {
+            for (const auto& [handle, f] : *filters) {
+                if (f->persistent()) {
+                    f->save(last);
+                }
+            }
+            return true;
+        });
+    } catch (...) {
+        // the filters are rebuilt on the next open
+    }
+}
+
+dbi_registry* dbi_registry::of(MDB_env* env) {
+    auto context = env_context::of(env);
+    return context? &context->registry() : nullptr;
+}
+
+std::optional<dbi_registry::entry> dbi_registry::find(const std::string& name) const {
+    auto snapshot = std::atomic_load(&table_);
+    auto it = snapshot->find(name);
+    if (it == snapshot->end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::optional<std::string> dbi_registry::name(MDB_dbi db) const {
+    auto snapshot = std::atomic_load(&names_);
+    auto it = snapshot->find(db);
+    if (it == snapshot->end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void dbi_registry::named(MDB_dbi db, const std::string& name) {
+    std::lock_guard<std::mutex> lock(names_mutex_);
+    auto current = std::atomic_load(&names_);
+    auto it = current->find(db);
+    if (it != current->end() && it->second == name) {
+        return;
+    }
+    // a slot freed by an aborted create may be reused for another name
+    auto next = std::make_shared<name_table>(*current);
+    next->insert_or_assign(db, name);
+    std::atomic_store(&names_, std::shared_ptr<const name_table>(next));
+}
+
+void dbi_registry::preload() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MDB_txn *txn;
+    if (mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn)) {
+        throw std::runtime_error("failed to begin transaction");
+    }
+    auto next = std::make_shared<table>(*std::atomic_load(&table_));
+    try {
+        MDB_dbi main;
+        MDB_cursor *cursor;
+        if (mdb_dbi_open(txn, nullptr, 0, &main) || mdb_cursor_open(txn, main, &cursor)) {
+            throw std::runtime_error("failed to open cursor");
+        }
+        MDB_val key, data;
+        while (!mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) {
+            std::string name(static_cast<const char*>(key.mv_data), key.mv_size);
+            if (name.find('\0') != std::string::npos) {
+                continue;
+            }
+            MDB_dbi handle;
+            int err = mdb_dbi_open(txn, name.c_str(), 0, &handle);
+            if (err == MDB_INCOMPATIBLE) {
+                continue; // a plain record of the main database
+            }
+            if (err == MDB_DBS_FULL) {
+                break;
+            }
+            entry e{dbi(handle), 0, nullptr, nullptr};
+            if (err || mdb_dbi_flags(txn, handle, &e.flags)) {
+                mdb_cursor_close(cursor);
+                throw std::runtime_error("failed to open dbi");
+            }
+            next->insert_or_assign(name, e);
+            named(handle, name);
+        }
+        mdb_cursor_close(cursor);
+    } catch (...) {
+        mdb_txn_abort(txn);
+        throw;
+    }
+    // committing keeps the handles open for other transactions
+    if (mdb_txn_commit(txn)) {
+        throw std::runtime_error("failed to commit transaction");
+    }
+    std::atomic_store(&table_, std::shared_ptr<const table>(next));
+}
+
+dbi dbi_registry::open(const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort) {
+    auto e = lookup(name, flags, compare, dupsort);
+    if (!e) {
+        throw std::runtime_error("db not found");
+    }
+    return e->db;
+}
+
+dbi dbi_registry::open(MDB_txn* txn, const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort) {
+    auto e = find(name);
+    if (e && !matches(*e, flags, compare, dupsort)) {
+        // installs the comparators asked for
+        e = lookup(name, flags & ~MDB_CREATE, compare, dupsort);
+    }
+    // a transaction only sees the handles opened before it began
+    unsigned int current;
+    if (e && !mdb_dbi_flags(txn, e->db.handle(), &current)) {
+        return e->db;
+    }
+
+    // not registered yet, created by another process or in txn, or
+    // registered after txn began: open it in txn like mdb_dbi_open does
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (e && next_slot(txn) != e->db.handle()) {
+        // mdb_dbi_open would take the slot of another database
+        throw std::runtime_error("db opened after the transaction began");
+    }
+    MDB_dbi handle;
+    check_open(mdb_dbi_open(txn, name.c_str(), flags, &handle));
+    named(handle, name);
+    dbi result(handle);
+    compare = compare? compare : e? e->compare : nullptr;
+    dupsort = dupsort? dupsort : e? e->dupsort : nullptr;
+    if (compare) {
+        result.set_compare(txn, compare);
+    }
+    if (dupsort) {
+        result.set_dupsort(txn, dupsort);
+    }
+    return result;
+}
+
+MDB_dbi dbi_registry::next_slot(MDB_txn* txn) const {
+    // the handles below the first slot txn cannot see are all open
+    MDB_dbi next = 2;
+    unsigned int flags;
+    for (const auto& [handle, name] : *std::atomic_load(&names_)) {
+        if (handle >= next && !mdb_dbi_flags(txn, handle, &flags)) {
+            next = handle + 1;
+        }
+    }
+    return next;
+}
+
+std::optional<dbi_registry::entry> dbi_registry::lookup(const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort) {
+    auto e = find(name);
+    if (e && matches(*e, flags, compare, dupsort)) {
+        return e;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    e = find(name);
+    if (e && matches(*e, flags, compare, dupsort)) {
+        return e;
+    }
+    // probed before and nothing committed since
+    MDB_envinfo info;
+    bool probe = !e && !(flags & MDB_CREATE) && !mdb_env_info(env_, &info);
+    if (probe) {
+        auto miss = absent_.find(name);
+        if (miss != absent_.end() && miss->second == info.me_last_txnid) {
+            return std::nullopt;
+        }
+    }
+    // opened for the first time, or to install the comparators asked for
+    auto result = open_dedicated(name, e? flags & ~MDB_CREATE : flags,
+        compare? compare : e? e->compare : nullptr, dupsort? dupsort : e? e->dupsort : nullptr);
+    if (result) {
+        absent_.erase(name);
+        matches(*result, flags, compare, dupsort);
+    } else if (probe) {
+        // the snapshot of the probe was at least as recent
+        absent_[name] = info.me_last_txnid;
+    }
+    return result;
+}
+
+std::optional<dbi_registry::entry> dbi_registry::open_dedicated(const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort) {
+    // a helper thread has no transaction of its own on this env
+    return std::async(std::launch::async, [&]() -> std::optional<entry> {
+        bool create = flags & MDB_CREATE;
+        MDB_txn *txn;
+        if (mdb_txn_begin(env_, nullptr, create? 0 : MDB_RDONLY, &txn)) {
+            throw std::runtime_error("failed to begin transaction");
+        }
+        MDB_dbi handle;
+        int err = mdb_dbi_open(txn, name.c_str(), flags, &handle);
+        if (err == MDB_NOTFOUND && !create) {
+            mdb_txn_abort(txn);
+            return std::nullopt;
+        }
+        entry e{dbi(handle), 0, compare, dupsort};
+        try {
+            check_open(err);
+            if (compare) {
+                e.db.set_compare(txn, compare);
+            }
+            if (dupsort) {
+                e.db.set_dupsort(txn, dupsort);
+            }
+            if (mdb_dbi_flags(txn, handle, &e.flags)) {
+                throw std::runtime_error("failed to get dbi flags");
+            }
+        } catch (...) {
+            mdb_txn_abort(txn);
+            throw;
+        }
+        // committing keeps the handle open for other transactions
+        uint64_t txnid = mdb_txn_id(txn);
+        if (create) {
+            committing(txnid);
+        }
+        if (mdb_txn_commit(txn)) {
+            if (create) {
+                abandoned(txnid);
+            }
+            throw std::runtime_error("failed to commit transaction");
+        }
+        if (create) {
+            committed(txnid);
+        }
+        publish(name, e);
+        return e;
+    }).get();
+}
+
+key_filter& dbi_registry::enable_filter(const std::string& name, const key_filter::options& opts) {
+    dbi db = open(name);
+    if (auto f = filter(db.handle())) {
+        return *f;
+    }
+    auto options = opts;
+    if (options.path.empty()) {
+        options.path = side_file(env_, name + ".filter");
+    }
+    auto result = std::make_shared<key_filter>(env_, db.handle(), options);
+
+    // no commit may happen between loading the side file and publishing the
+    // filter; mutex_ is not held while waiting, a writer may need it to open a db
+    std::shared_ptr<key_filter> enabled;
+    bool loaded = with_write_lock(env_, [&](uint64_t last) {
+        std::lock_guard<std::mutex> lock(filters_mutex_);
+        auto current = std::atomic_load(&filters_);
+        auto it = current->find(db.handle());
+        if (it != current->end()) {
+            enabled = it->second;
+            return true;
+        }
+        enabled = result;
+        bool ok = options.persist && result->load(last);
+        auto next = std::make_shared<filter_table>(*current);
+        next->emplace(db.handle(), result);
+        std::atomic_store(&filters_, std::shared_ptr<const filter_table>(next));
+        has_filters_ = true;
+        return ok;
+    });
+    if (!loaded) {
+        enabled->rebuild();
+    }
+    return *enabled;
+}
+
+key_filter* dbi_registry::filter(MDB_dbi db) const {
+    if (!has_filters_.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    auto snapshot = std::atomic_load(&filters_);
+    auto it = snapshot->find(db);
+    return it == snapshot->end()? nullptr : it->second.get();
+}
+
+void dbi_registry::committing(uint64_t txnid) {
+    in_flight_ = txnid;
+}
+
+void dbi_registry::committed(uint64_t txnid) {
+    MDB_envinfo info;
+    if (mdb_env_info(env_, &info) || info.me_last_txnid < txnid) {
+        // nothing was written, the next writer reuses the id
+        abandoned(txnid);
+        return;
+    }
+    uint64_t previous = last_commit_.exchange(txnid);
+    if (previous + 1 < txnid) {
+        // the transactions in between were committed some other way
+        uint64_t gap = last_gap_.load();
+        while (gap < txnid - 1 && !last_gap_.compare_exchange_weak(gap, txnid - 1));
+    }
+}
+
+void dbi_registry::abandoned(uint64_t txnid) {
+    // another process may take the id once the write lock is released, the
+    // next local commit then sees the gap
+    uint64_t expected = txnid;
+    in_flight_.compare_exchange_strong(expected, 0);
+}
+
+uint64_t dbi_registry::last_foreign(uint64_t last) const {
+    uint64_t local = std::max(last_commit_.load(), in_flight_.load());
+    return last > local? last : last_gap_.load();
+}
+
+void dbi_registry::publish(const std::string& name, const entry& e) {
+    auto next = std::make_shared<table>(*std::atomic_load(&table_));
+    next->insert_or_assign(name, e);
+    std::atomic_store(&table_, std::shared_ptr<const table>(next));
+    named(e.db.handle(), name);
+}
+
+}
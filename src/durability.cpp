@@ -0,0 +1,119 @@
+#include "lmdb-wrapper/durability.hpp"
+
+#include <stdexcept>
+
+namespace lmdb {
+
+namespace {
+
+uint64_t last_txnid(MDB_env* env) {
+    MDB_envinfo info;
+    if (mdb_env_info(env, &info)) {
+        throw std::runtime_error("failed to get env info");
+    }
+    return info.me_last_txnid;
+}
+
+}
+
+flusher::flusher(MDB_env* env, const durability_policy& policy):
+    env_{env}, policy_{policy}, durable_{last_txnid(env)}, pending_{0}, requested_{false}, stop_{false} {
+
+    thread_ = std::thread([this]() {
+        run();
+    });
+}
+
+flusher::~flusher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    for (auto& [txnid, waiter] : waiters_) {
+        waiter.set_exception(std::make_exception_ptr(std::runtime_error("env closed")));
+    }
+}
+
+void flusher::committed() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pending_;
+    if (policy_.commits && pending_ >= policy_.commits) {
+        cv_.notify_one();
+    }
+}
+
+std::future<void> flusher::durable(uint64_t txnid) {
+    if (txnid > last_txnid(env_) + 1) {
+        throw std::runtime_error("transaction id not assigned yet");
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return wait_locked(txnid);
+}
+
+std::future<void> flusher::flush() {
+    uint64_t txnid = last_txnid(env_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    requested_ = true;
+    cv_.notify_one();
+    return wait_locked(txnid);
+}
+
+uint64_t flusher::durable_txnid() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return durable_;
+}
+
+std::future<void> flusher::wait_locked(uint64_t txnid) {
+    std::promise<void> waiter;
+    auto result = waiter.get_future();
+    if (txnid <= durable_) {
+        waiter.set_value();
+    } else {
+        waiters_.emplace(txnid, std::move(waiter));
+    }
+    return result;
+}
+
+void flusher::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait_for(lock, policy_.interval, [&]() {
+            return stop_ || requested_ || (policy_.commits && pending_ >= policy_.commits);
+        });
+        bool stopping = stop_;
+        uint64_t durable = durable_;
+        pending_ = 0;
+        requested_ = false;
+        lock.unlock();
+
+        // everything committed before the sync starts is on disk once it returns
+        MDB_envinfo info;
+        int err = mdb_env_info(env_, &info);
+        uint64_t target = err? durable : info.me_last_txnid;
+        if (!err && target > durable) {
+            err = mdb_env_sync(env_, 1);
+        }
+
+        lock.lock();
+        if (!err) {
+            durable_ = std::max(durable_, target);
+            auto end = waiters_.upper_bound(durable_);
+            for (auto it = waiters_.begin(); it != end; ++it) {
+                it->second.set_value();
+            }
+            waiters_.erase(waiters_.begin(), end);
+        } else {
+            for (auto& [txnid, waiter] : waiters_) {
+                waiter.set_exception(std::make_exception_ptr(std::runtime_error("failed to sync env")));
+            }
+            waiters_.clear();
+        }
+        if (stopping) {
+            break;
+        }
+    }
+}
+
+}
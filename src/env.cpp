@@ -1,4 +1,5 @@
 #include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/env_context.hpp"
 
 
 namespace lmdb {
@@ -11,8 +12,47 @@ MDB_env* env::handle() const {
     return env_.get();
 }
 
+dbi_registry& env::dbis() const {
+    auto registry = dbi_registry::of(env_.get());
+    if (!registry) {
+        throw std::runtime_error("env has no dbi registry");
+    }
+    return *registry;
+}
+
+std::future<void> env::durable(uint64_t txnid) const {
+    auto context = env_context::of(env_.get());
+    if (!context || !context->flusher()) {
+        throw std::runtime_error("env has no durability policy");
+    }
+    return context->flusher()->durable(txnid);
+}
+
+std::future<void> env::flush() const {
+    auto context = env_context::of(env_.get());
+    if (!context || !context->flusher()) {
+        throw std::runtime_error("env has no durability policy");
+    }
+    return context->flusher()->flush();
+}
+
+void env::save_page_profile() const {
+    auto context = env_context::of(env_.get());
+    std::string path = context && context->warmup()? context->warmup()->path : std::string();
+    page_profile::record(env_.get()).save(path.empty()? page_profile::default_path(env_.get()) : path);
+}
+
+reader_monitor& env::monitor() const {
+    auto context = env_context::of(env_.get());
+    if (!context || !context->monitor()) {
+        throw std::runtime_error("env has no reader monitor");
+    }
+    return *context->monitor();
+}
+
 void env::deleter::operator()(MDB_env *ptr) {
     if (ptr) {
+        delete env_context::of(ptr);
         mdb_env_close(ptr);
     }
 }
@@ -32,6 +72,22 @@ env::factory& env::factory::set_max_dbs(MDB_dbi dbs) {
     return *this;
 }
 
+env::factory& env::factory::set_durability(const durability_policy& policy) {
+    durability_ = policy;
+    return *this;
+}
+
+env::factory& env::factory::set_warmup(const warmup_options& opts) {
+    warmup_ = opts;
+    return *this;
+}
+
+env::factory& env::factory::set_reader_monitor(const reader_monitor_options& opts, reader_monitor::callback on_stale) {
+    monitor_ = opts;
+    on_stale_ = std::move(on_stale);
+    return *this;
+}
+
 env::factory& env::factory::set(env::flags flag) {
     flags_ |= static_cast<unsigned int>(flag);
     return *this;
@@ -58,6 +114,7 @@ env env::factory::open(const std::string& path, mdb_mode_t mode) {
     if (!result) {
         throw std::runtime_error("invalid env");
     }
+    mdb_env_set_userctx(result.get(), new env_context(result.get()));
 
     if (max_dbs_) {
         int err = mdb_env_set_maxdbs(result.get(), *max_dbs_);
@@ -84,7 +141,9 @@ env env::factory::open(const std::string& path, mdb_mode_t mode) {
         }
     }
 
-    int err = mdb_env_open(result.get(), path.c_str(), flags_, mode);
+    // commits return without syncing, the flusher bounds what a crash loses
+    unsigned int flags = durability_? flags_ | MDB_NOSYNC : flags_;
+    int err = mdb_env_open(result.get(), path.c_str(), flags, mode);
     switch (err) {
         case 0:
             break; // success
@@ -101,6 +160,19 @@ env env::factory::open(const std::string& path, mdb_mode_t mode) {
         default:
             throw std::runtime_error("failed to open env");
     }
+    if (max_dbs_) {
+        env_context::of(result.get())->registry().preload();
+    }
+    if (durability_ && !(flags_ & MDB_RDONLY)) {
+        env_context::of(result.get())->start_flusher(*durability_);
+    }
+    if (monitor_) {
+        env_context::of(result.get())->start_monitor(*monitor_, on_stale_);
+    }
+    if (warmup_) {
+        env_context::of(result.get())->set_warmup(*warmup_);
+        warmup::run(result.get(), *warmup_);
+    }
     return env{result};
 }
 
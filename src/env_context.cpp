@@ -0,0 +1,51 @@
+#include "lmdb-wrapper/env_context.hpp"
+
+namespace lmdb {
+
+env_context::env_context(MDB_env* env):env_{env}, registry_{env} {
+
+}
+
+env_context::~env_context() {
+    if (warmup_ && warmup_->record_on_close) {
+        try {
+            page_profile::record(env_).save(warmup_->path.empty()? page_profile::default_path(env_) : warmup_->path);
+        } catch (...) {
+            // the next open starts cold
+        }
+    }
+}
+
+env_context* env_context::of(MDB_env* env) {
+    return env? static_cast<env_context*>(mdb_env_get_userctx(env)) : nullptr;
+}
+
+dbi_registry& env_context::registry() {
+    return registry_;
+}
+
+lmdb::flusher* env_context::flusher() const {
+    return flusher_.get();
+}
+
+void env_context::start_flusher(const durability_policy& policy) {
+    flusher_ = std::make_unique<lmdb::flusher>(env_, policy);
+}
+
+reader_monitor* env_context::monitor() const {
+    return monitor_.get();
+}
+
+void env_context::start_monitor(const reader_monitor_options& opts, reader_monitor::callback on_stale) {
+    monitor_ = std::make_unique<reader_monitor>(env_, opts, std::move(on_stale));
+}
+
+const std::optional<warmup_options>& env_context::warmup() const {
+    return warmup_;
+}
+
+void env_context::set_warmup(const warmup_options& opts) {
+    warmup_ = opts;
+}
+
+}
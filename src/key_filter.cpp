@@ -0,0 +1,305 @@
+#include "lmdb-wrapper/key_filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+namespace lmdb {
+
+namespace {
+
+constexpr size_t block_bits = 512;
+constexpr size_t block_words = block_bits / 64;
+constexpr char magic[8] = {'L', 'M', 'D', 'B', 'F', 'L', 'T', '1'};
+
+struct file_header {
+    char magic[8];
+    uint64_t txnid;
+    uint64_t blocks;
+    uint64_t k;
+    uint64_t entries;
+};
+
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t hash(const MDB_val& key) {
+    uint64_t h = 14695981039346656037ULL;
+    auto p = static_cast<const unsigned char*>(key.mv_data);
+    for (size_t i = 0; i < key.mv_size; ++i) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return mix(h);
+}
+
+}
+
+struct key_filter::bits {
+    bits(size_t blocks, unsigned int k):blocks{blocks}, k{k}, words{new std::atomic<uint64_t>[blocks * block_words]} {
+        for (size_t i = 0; i < blocks * block_words; ++i) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // one block per key, the probes within it come from a second hash
+    void add(uint64_t h) {
+        auto block = &words[(h % blocks) * block_words];
+        uint64_t h2 = mix(h ^ 0x9e3779b97f4a7c15ULL);
+        uint32_t a = static_cast<uint32_t>(h2), b = static_cast<uint32_t>(h2 >> 32) | 1;
+        for (unsigned int i = 0; i < k; ++i) {
+            uint32_t pos = (a + i * b) % block_bits;
+            block[pos / 64].fetch_or(uint64_t(1) << (pos % 64), std::memory_order_release);
+        }
+    }
+
+    bool test(uint64_t h) const {
+        auto block = &words[(h % blocks) * block_words];
+        uint64_t h2 = mix(h ^ 0x9e3779b97f4a7c15ULL);
+        uint32_t a = static_cast<uint32_t>(h2), b = static_cast<uint32_t>(h2 >> 32) | 1;
+        for (unsigned int i = 0; i < k; ++i) {
+            uint32_t pos = (a + i * b) % block_bits;
+            if (!(block[pos / 64].load(std::memory_order_acquire) & (uint64_t(1) << (pos % 64)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    size_t blocks;
+    unsigned int k;
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+};
+
+key_filter::key_filter(MDB_env* env, MDB_dbi dbi, const options& opts):
+    env_{env}, dbi_{dbi}, options_{opts}, ready_{false}, base_{0}, entries_{0}, stale_{0}, builds_{0}, stop_{false}, building_{false} {
+
+}
+
+key_filter::~key_filter() {
+    stop();
+}
+
+bool key_filter::may_contain(const MDB_val& key, uint64_t foreign) {
+    if (!ready_.load(std::memory_order_acquire)) {
+        return true;
+    }
+    if (foreign > base_) {
+        if (!building_) {
+            rebuild();
+        }
+        return true;
+    }
+    return std::atomic_load(&live_)->test(hash(key));
+}
+
+void key_filter::add(const MDB_val& key) {
+    uint64_t h = hash(key);
+    // pending before live: a rebuild makes its filter live before it clears pending
+    if (auto next = std::atomic_load(&pending_)) {
+        next->add(h);
+    }
+    bool known = false;
+    if (auto current = std::atomic_load(&live_)) {
+        known = current->test(h);
+        current->add(h);
+    }
+    // overwrites must not inflate the sizing and the rebuild ratio
+    if (!known) {
+        ++entries_;
+    }
+}
+
+void key_filter::removed() {
+    size_t stale = ++stale_;
+    if (ready_ && stale > options_.rebuild_ratio * entries_) {
+        rebuild();
+    }
+}
+
+bool key_filter::ready() const {
+    return ready_;
+}
+
+size_t key_filter::entries() const {
+    return entries_;
+}
+
+size_t key_filter::stale() const {
+    return stale_;
+}
+
+size_t key_filter::size_bytes() const {
+    auto current = std::atomic_load(&live_);
+    return current? current->blocks * block_bits / 8 : 0;
+}
+
+size_t key_filter::builds() const {
+    return builds_;
+}
+
+void key_filter::rebuild() {
+    std::lock_guard<std::mutex> lock(builder_mutex_);
+    if (building_) {
+        return;
+    }
+    if (builder_.joinable()) {
+        builder_.join();
+    }
+    building_ = true;
+    stop_ = false;
+    ++builds_;
+    builder_ = std::thread([this]() {
+        try {
+            build();
+        } catch (...) {
+            std::atomic_store(&pending_, std::shared_ptr<bits>());
+        }
+        building_ = false;
+    });
+}
+
+void key_filter::stop() {
+    std::lock_guard<std::mutex> lock(builder_mutex_);
+    stop_ = true;
+    if (builder_.joinable()) {
+        builder_.join();
+    }
+}
+
+std::shared_ptr<key_filter::bits> key_filter::make_bits(size_t keys) const {
+    const double ln2 = std::log(2.0);
+    double bits_per_key = -std::log(std::clamp(options_.false_positive_rate, 1e-9, 0.5)) / (ln2 * ln2);
+    unsigned int k = static_cast<unsigned int>(std::clamp(std::lround(bits_per_key * ln2), 1L, 16L));
+    double total = std::min(std::max<size_t>(keys, 1024) * bits_per_key, options_.max_bytes * 8.0);
+    size_t blocks = std::max<size_t>(1, static_cast<size_t>(total) / block_bits);
+    return std::make_shared<bits>(blocks, k);
+}
+
+void key_filter::build() {
+    // the empty filter becomes pending under the write lock, so every put is
+    // either committed before the scan snapshot or added to it as well
+    MDB_txn *txn;
+    if (mdb_txn_begin(env_, nullptr, 0, &txn) && mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn)) {
+        return;
+    }
+    MDB_stat st;
+    if (mdb_stat(txn, dbi_, &st)) {
+        mdb_txn_abort(txn);
+        return;
+    }
+    auto next = make_bits(options_.expected_keys? options_.expected_keys : st.ms_entries + st.ms_entries / 4);
+    std::atomic_store(&pending_, next);
+    mdb_txn_abort(txn);
+
+    MDB_cursor *cursor = nullptr;
+    int err = mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn);
+    if (!err && (err = mdb_cursor_open(txn, dbi_, &cursor))) {
+        mdb_txn_abort(txn);
+    }
+    if (err) {
+        std::atomic_store(&pending_, std::shared_ptr<bits>());
+        return;
+    }
+    uint64_t snapshot = mdb_txn_id(txn);
+    size_t count = 0;
+    MDB_val key, data;
+    err = mdb_cursor_get(cursor, &key, &data, MDB_FIRST);
+    while (!err && !stop_) {
+        next->add(hash(key));
+        ++count;
+        err = mdb_cursor_get(cursor, &key, &data, MDB_NEXT_NODUP);
+    }
+    mdb_cursor_close(cursor);
+    mdb_txn_abort(txn);
+    if (err != MDB_NOTFOUND) {
+        std::atomic_store(&pending_, std::shared_ptr<bits>());
+        return;
+    }
+
+    std::atomic_store(&live_, next);
+    std::atomic_store(&pending_, std::shared_ptr<bits>());
+    base_ = snapshot;
+    entries_ = count;
+    stale_ = 0;
+    ready_ = true;
+}
+
+void key_filter::save(uint64_t txnid) const {
+    auto current = std::atomic_load(&live_);
+    if (!ready_ || !current) {
+        return;
+    }
+    file_header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.txnid = txnid;
+    header.blocks = current->blocks;
+    header.k = current->k;
+    header.entries = entries_;
+
+    std::string tmp = options_.path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        std::vector<uint64_t> chunk(block_words);
+        for (size_t b = 0; b < current->blocks; ++b) {
+            for (size_t i = 0; i < block_words; ++i) {
+                chunk[i] = current->words[b * block_words + i].load(std::memory_order_relaxed);
+            }
+            out.write(reinterpret_cast<const char*>(chunk.data()), chunk.size() * sizeof(uint64_t));
+        }
+        if (!out) {
+            throw std::runtime_error("failed to write filter");
+        }
+    }
+    if (std::rename(tmp.c_str(), options_.path.c_str())) {
+        throw std::runtime_error("failed to write filter");
+    }
+}
+
+bool key_filter::load(uint64_t txnid) {
+    std::ifstream in(options_.path, std::ios::binary);
+    file_header header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        return false;
+    }
+    // a filter saved at another transaction may miss keys
+    if (std::memcmp(header.magic, magic, sizeof(magic)) || header.txnid != txnid || !header.blocks || !header.k || header.k > 16) {
+        return false;
+    }
+    auto loaded = std::make_shared<bits>(header.blocks, static_cast<unsigned int>(header.k));
+    std::vector<uint64_t> chunk(block_words);
+    for (size_t b = 0; b < loaded->blocks; ++b) {
+        if (!in.read(reinterpret_cast<char*>(chunk.data()), chunk.size() * sizeof(uint64_t))) {
+            return false;
+        }
+        for (size_t i = 0; i < block_words; ++i) {
+            loaded->words[b * block_words + i].store(chunk[i], std::memory_order_relaxed);
+        }
+    }
+    std::atomic_store(&live_, loaded);
+    base_ = txnid;
+    entries_ = header.entries;
+    stale_ = 0;
+    ready_ = true;
+    return true;
+}
+
+const std::string& key_filter::path() const {
+    return options_.path;
+}
+
+bool key_filter::persistent() const {
+    return options_.persist;
+}
+
+}
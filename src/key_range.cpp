@@ -0,0 +1,130 @@
+#include "lmdb-wrapper/key_range.hpp"
+
+#include <cstring>
+#include <optional>
+
+namespace lmdb {
+
+namespace {
+
+MDB_val to_val(const std::string& s) {
+    return MDB_val{s.size(), const_cast<char*>(s.data())};
+}
+
+/**
+    Smallest byte string greater than every string with the given prefix, if any.
+*/
+std::optional<std::string> prefix_end(std::string p) {
+    while (!p.empty() && static_cast<unsigned char>(p.back()) == 0xff) {
+        p.pop_back();
+    }
+    if (p.empty()) {
+        return std::nullopt;
+    }
+    p.back() = static_cast<char>(static_cast<unsigned char>(p.back()) + 1);
+    return p;
+}
+
+}
+
+key_range::key_range():has_lo_{false}, has_hi_{false}, has_prefix_{false}, reverse_{false} {
+
+}
+
+key_range key_range::all() {
+    return key_range();
+}
+
+key_range key_range::reversed() const {
+    key_range result = *this;
+    result.reverse_ = !reverse_;
+    return result;
+}
+
+bool key_range::is_reverse() const {
+    return reverse_;
+}
+
+void key_range::set_lo(const MDB_val& key) {
+    lo_.assign(static_cast<const char*>(key.mv_data), key.mv_size);
+    has_lo_ = true;
+}
+
+void key_range::set_hi(const MDB_val& key) {
+    hi_.assign(static_cast<const char*>(key.mv_data), key.mv_size);
+    has_hi_ = true;
+}
+
+void key_range::set_prefix(const MDB_val& key) {
+    prefix_.assign(static_cast<const char*>(key.mv_data), key.mv_size);
+    has_prefix_ = true;
+}
+
+int key_range::first(MDB_cursor* cursor, MDB_val& key, MDB_val& data) const {
+    int err;
+    if (!reverse_) {
+        if (has_lo_ || has_prefix_) {
+            key = to_val(has_lo_? lo_ : prefix_);
+            err = mdb_cursor_get(cursor, &key, &data, MDB_SET_RANGE);
+        } else {
+            err = mdb_cursor_get(cursor, &key, &data, MDB_FIRST);
+        }
+        return check(cursor, err, key);
+    }
+
+    // last entry before the upper bound
+    std::optional<std::string> end;
+    if (has_hi_) {
+        end = hi_;
+    } else if (has_prefix_) {
+        end = prefix_end(prefix_);
+    }
+    if (end) {
+        key = to_val(*end);
+        err = mdb_cursor_get(cursor, &key, &data, MDB_SET_RANGE);
+        switch (err) {
+            case 0:
+                err = mdb_cursor_get(cursor, &key, &data, MDB_PREV);
+                break;
+            case MDB_NOTFOUND:
+                err = mdb_cursor_get(cursor, &key, &data, MDB_LAST);
+                break;
+        }
+    } else {
+        err = mdb_cursor_get(cursor, &key, &data, MDB_LAST);
+    }
+    return check(cursor, err, key);
+}
+
+int key_range::next(MDB_cursor* cursor, MDB_val& key, MDB_val& data) const {
+    int err = mdb_cursor_get(cursor, &key, &data, reverse_? MDB_PREV : MDB_NEXT);
+    return check(cursor, err, key);
+}
+
+bool key_range::contains(MDB_txn* txn, MDB_dbi dbi, const MDB_val& key) const {
+    if (has_lo_) {
+        MDB_val lo = to_val(lo_);
+        if (mdb_cmp(txn, dbi, &key, &lo) < 0) {
+            return false;
+        }
+    }
+    if (has_hi_) {
+        MDB_val hi = to_val(hi_);
+        if (mdb_cmp(txn, dbi, &key, &hi) >= 0) {
+            return false;
+        }
+    }
+    if (has_prefix_) {
+        return key.mv_size >= prefix_.size() && !std::memcmp(key.mv_data, prefix_.data(), prefix_.size());
+    }
+    return true;
+}
+
+int key_range::check(MDB_cursor* cursor, int err, const MDB_val& key) const {
+    if (err) {
+        return err;
+    }
+    return contains(mdb_cursor_txn(cursor), mdb_cursor_dbi(cursor), key)? 0 : MDB_NOTFOUND;
+}
+
+}
@@ -0,0 +1,254 @@
+#include "lmdb-wrapper/reader_monitor.hpp"
+#include "lmdb-wrapper/env_context.hpp"
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+namespace lmdb {
+
+namespace {
+
+// the ids mdb_reader_list prints
+uint64_t current_thread() {
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    // pthread_t is an integer or a pointer depending on the platform
+    return (uint64_t)(size_t)pthread_self();
+#endif
+}
+
+int current_pid() {
+#ifdef _WIN32
+    return static_cast<int>(GetCurrentProcessId());
+#else
+    return getpid();
+#endif
+}
+
+thread_local const char *thread_label = nullptr;
+
+int append_message(const char* msg, void* ctx) {
+    static_cast<std::string*>(ctx)->append(msg);
+    return 0;
+}
+
+}
+
+reader_monitor::reader_monitor(MDB_env* env, const reader_monitor_options& opts, callback on_stale):
+    env_{env}, options_{opts}, on_stale_{std::move(on_stale)}, stop_{false}, space_{}, counted_{} {
+
+    thread_ = std::thread([this]() {
+        run();
+    });
+}
+
+reader_monitor::~reader_monitor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+std::vector<reader_info> reader_monitor::readers() {
+    MDB_envinfo info;
+    if (mdb_env_info(env_, &info)) {
+        throw std::runtime_error("failed to get env info");
+    }
+    return list(info.me_last_txnid);
+}
+
+space_info reader_monitor::space() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return space_;
+}
+
+void reader_monitor::label_thread(const char* label) {
+    thread_label = label;
+}
+
+reader_monitor* reader_monitor::of(MDB_txn* txn) {
+    auto context = env_context::of(mdb_txn_env(txn));
+    auto monitor = context? context->monitor() : nullptr;
+    return monitor && monitor->options_.track_origins? monitor : nullptr;
+}
+
+void reader_monitor::began(MDB_txn* txn) {
+    if (auto monitor = of(txn)) {
+        std::lock_guard<std::mutex> lock(monitor->origins_mutex_);
+        monitor->origins_[txn] = origin{current_thread(), mdb_txn_id(txn), std::chrono::steady_clock::now(), thread_label};
+    }
+}
+
+void reader_monitor::ended(MDB_txn* txn) {
+    if (auto monitor = of(txn)) {
+        std::lock_guard<std::mutex> lock(monitor->origins_mutex_);
+        monitor->origins_.erase(txn);
+    }
+}
+
+std::vector<reader_info> reader_monitor::list(uint64_t last_txnid) {
+    std::string table;
+    if (mdb_reader_list(env_, &append_message, &table) < 0) {
+        throw std::runtime_error("failed to list readers");
+    }
+
+    std::vector<reader_info> result;
+    std::istringstream lines(table);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+        reader_info r{};
+        std::string txnid;
+        if (!(fields >> r.pid >> std::hex >> r.thread >> std::dec >> txnid)) {
+            continue; // header or "(no active readers)"
+        }
+        if (txnid != "-") {
+            r.txnid = std::stoull(txnid);
+            r.lag = last_txnid > *r.txnid? last_txnid - *r.txnid : 0;
+        }
+        result.push_back(r);
+    }
+
+    std::map<std::pair<uint64_t, uint64_t>, origin> origins;
+    {
+        std::lock_guard<std::mutex> lock(origins_mutex_);
+        for (const auto& [txn, o] : origins_) {
+            origins.emplace(std::make_pair(o.thread, o.txnid), o);
+        }
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    int pid = current_pid();
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<reader_key, std::chrono::steady_clock::time_point> seen;
+    for (auto& r : result) {
+        reader_key key(r.pid, r.thread, r.txnid.value_or(0));
+        auto first = first_seen_.find(key);
+        auto start = first == first_seen_.end()? now : first->second;
+        seen.emplace(key, start);
+        if (r.pid == pid && r.txnid) {
+            auto o = origins.find(std::make_pair(r.thread, *r.txnid));
+            if (o != origins.end()) {
+                start = o->second.start;
+                r.tracked = true;
+                r.label = o->second.label;
+            }
+        }
+        r.age = std::chrono::duration_cast<std::chrono::milliseconds>(now - start);
+    }
+    first_seen_.swap(seen);
+    for (auto it = reported_.begin(); it != reported_.end();) {
+        it = first_seen_.count(*it)? std::next(it) : reported_.erase(it);
+    }
+    return result;
+}
+
+space_info reader_monitor::sample() {
+    space_info result{};
+    MDB_envinfo info;
+    MDB_stat st;
+    if (mdb_env_info(env_, &info) || mdb_env_stat(env_, &st)) {
+        throw std::runtime_error("failed to get env info");
+    }
+    result.last_txnid = info.me_last_txnid;
+    result.page_size = st.ms_psize;
+    result.map_size = info.me_mapsize;
+    result.used_pages = info.me_last_pgno + 1;
+
+    MDB_txn *txn;
+    if (mdb_txn_begin(env_, nullptr, MDB_RDONLY, &txn)) {
+        throw std::runtime_error("failed to begin transaction");
+    }
+    try {
+        MDB_stat free_st;
+        if (mdb_stat(txn, 0, &free_st)) {
+            throw std::runtime_error("failed to get db stat");
+        }
+        result.freelist_entries = free_st.ms_entries;
+
+        auto now = std::chrono::steady_clock::now();
+        bool due = !counted_at_ || (now - *counted_at_ >= options_.freelist_interval && counted_.free_txnid != mdb_txn_id(txn));
+        if (due) {
+            count_free(txn, result);
+            counted_at_ = now;
+            counted_ = result;
+        } else {
+            result.free_pages = counted_.free_pages;
+            result.free_txnid = counted_.free_txnid;
+        }
+    } catch (...) {
+        mdb_txn_abort(txn);
+        throw;
+    }
+    mdb_txn_abort(txn);
+    return result;
+}
+
+void reader_monitor::count_free(MDB_txn* txn, space_info& s) {
+    // the free database lists the pages freed by each transaction, like mdb_stat -f
+    MDB_cursor *cursor;
+    if (mdb_cursor_open(txn, 0, &cursor)) {
+        throw std::runtime_error("failed to open cursor");
+    }
+    MDB_val key, data;
+    while (!mdb_cursor_get(cursor, &key, &data, MDB_NEXT)) {
+        size_t count;
+        std::memcpy(&count, data.mv_data, sizeof(count));
+        s.free_pages += count;
+    }
+    mdb_cursor_close(cursor);
+    s.free_txnid = mdb_txn_id(txn);
+}
+
+void reader_monitor::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        lock.unlock();
+        std::vector<reader_info> stale;
+        try {
+            int dead = 0;
+            mdb_reader_check(env_, &dead);
+            space_info s = sample();
+            s.dead_readers = dead;
+            auto current = list(s.last_txnid);
+
+            std::lock_guard<std::mutex> guard(mutex_);
+            if (space_.used_pages) {
+                s.used_growth = static_cast<int64_t>(s.used_pages) - static_cast<int64_t>(space_.used_pages);
+                s.free_growth = static_cast<int64_t>(s.free_pages) - static_cast<int64_t>(space_.free_pages);
+            }
+            space_ = s;
+            for (const auto& r : current) {
+                if (r.txnid && (r.age > options_.max_age || r.lag > options_.max_lag)
+                    && reported_.emplace(r.pid, r.thread, *r.txnid).second) {
+                    stale.push_back(r);
+                }
+            }
+        } catch (...) {
+            // try again next interval
+        }
+        if (on_stale_) {
+            for (const auto& r : stale) {
+                on_stale_(r);
+            }
+        }
+        lock.lock();
+        cv_.wait_for(lock, options_.interval, [&]() {
+            return stop_;
+        });
+    }
+}
+
+}
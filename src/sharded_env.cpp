@@ -0,0 +1,320 @@
+#include "lmdb-wrapper/sharded_env.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+namespace lmdb {
+
+namespace {
+
+std::string key_string(const MDB_val& key) {
+    return std::string(static_cast<const char*>(key.mv_data), key.mv_size);
+}
+
+}
+
+hash_partitioner::hash_partitioner(size_t shards):shards_{shards} {
+    if (!shards_) {
+        throw std::runtime_error("invalid shard count");
+    }
+}
+
+size_t hash_partitioner::shard(const MDB_val& key) const {
+    uint64_t hash = 14695981039346656037ull;
+    auto ptr = static_cast<const unsigned char*>(key.mv_data);
+    for (size_t i = 0; i < key.mv_size; ++i) {
+        hash ^= ptr[i];
+        hash *= 1099511628211ull;
+    }
+    return hash % shards_;
+}
+
+size_t hash_partitioner::size() const {
+    return shards_;
+}
+
+range_partitioner::range_partitioner(std::vector<std::string> bounds):bounds_{std::move(bounds)} {
+    if (!std::is_sorted(bounds_.begin(), bounds_.end())) {
+        throw std::runtime_error("unsorted bounds");
+    }
+}
+
+size_t range_partitioner::shard(const MDB_val& key) const {
+    return std::upper_bound(bounds_.begin(), bounds_.end(), key_string(key)) - bounds_.begin();
+}
+
+size_t range_partitioner::size() const {
+    return bounds_.size() + 1;
+}
+
+bool range_partitioner::contains(size_t index, const MDB_val& key) const {
+    return index < size() && shard(key) == index;
+}
+
+void range_partitioner::split(size_t index, const MDB_val& key) {
+    if (!contains(index, key) || (index > 0 && bounds_[index - 1] == key_string(key))) {
+        throw std::runtime_error("split key outside of shard");
+    }
+    bounds_.insert(bounds_.begin() + index, key_string(key));
+}
+
+
+sharded_env::shard::shard(env e, const std::vector<db_spec>& dbs):env_{e}, stop_{false} {
+    write_txn txn(env_.handle());
+    for (const auto& spec : dbs) {
+        dbi db(txn.handle(), spec.name, spec.flags);
+        if (spec.compare) {
+            db.set_compare(txn.handle(), spec.compare);
+        }
+        if (spec.dupsort) {
+            db.set_dupsort(txn.handle(), spec.dupsort);
+        }
+        dbis_.push_back(db);
+    }
+    txn.commit();
+    writer_ = std::thread(&shard::run, this);
+}
+
+sharded_env::shard::~shard() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+std::future<void> sharded_env::shard::submit(task t) {
+    return enqueue(std::move(t), false);
+}
+
+std::future<void> sharded_env::shard::submit_alone(task t) {
+    return enqueue(std::move(t), true);
+}
+
+std::future<void> sharded_env::shard::enqueue(task t, bool alone) {
+    operation op{std::move(t), std::promise<void>(), alone};
+    auto result = op.done.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) {
+            throw std::runtime_error("shard is closed");
+        }
+        queue_.push_back(std::move(op));
+    }
+    cv_.notify_one();
+    return result;
+}
+
+const dbi& sharded_env::shard::db(size_t index) const {
+    return dbis_.at(index);
+}
+
+const env& sharded_env::shard::environment() const {
+    return env_;
+}
+
+void sharded_env::shard::run() {
+    while (true) {
+        std::deque<operation> queued;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            queued.swap(queue_);
+        }
+
+        // in queue order, the tasks between two lone ones form a batch
+        while (!queued.empty()) {
+            if (queued.front().alone) {
+                auto op = std::move(queued.front());
+                queued.pop_front();
+                try {
+                    write_txn txn(env_.handle());
+                    op.apply(txn, dbis_);
+                    txn.commit();
+                    op.done.set_value();
+                } catch (...) {
+                    op.done.set_exception(std::current_exception());
+                }
+                continue;
+            }
+            std::deque<operation> batch;
+            while (!queued.empty() && !queued.front().alone) {
+                batch.push_back(std::move(queued.front()));
+                queued.pop_front();
+            }
+            commit(batch);
+        }
+    }
+}
+
+void sharded_env::shard::commit(std::deque<operation>& batch) {
+    // commit the whole batch at once, on failure retry each operation
+    // on its own so that one bad write does not fail its neighbours
+    try {
+        write_txn txn(env_.handle());
+        for (auto& op : batch) {
+            op.apply(txn, dbis_);
+        }
+        txn.commit();
+        for (auto& op : batch) {
+            op.done.set_value();
+        }
+        return;
+    } catch (...) {
+    }
+
+    for (auto& op : batch) {
+        try {
+            write_txn txn(env_.handle());
+            op.apply(txn, dbis_);
+            txn.commit();
+            op.done.set_value();
+        } catch (...) {
+            op.done.set_exception(std::current_exception());
+        }
+    }
+}
+
+
+sharded_env::sharded_env(env::factory f, mdb_mode_t mode, std::vector<std::unique_ptr<shard>> shards, std::shared_ptr<partitioner> p, std::vector<db_spec> dbs):
+    factory_{f}, mode_{mode}, shards_{std::move(shards)}, partitioner_{p}, dbs_{std::move(dbs)} {
+
+}
+
+size_t sharded_env::db_index(const std::string& db) const {
+    for (size_t i = 0; i < dbs_.size(); ++i) {
+        if (dbs_[i].name == db) {
+            return i;
+        }
+    }
+    throw std::runtime_error("db not found");
+}
+
+size_t sharded_env::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return shards_.size();
+}
+
+env sharded_env::shard_env(size_t index) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return shards_.at(index)->environment();
+}
+
+void sharded_env::split_at(size_t index, const MDB_val& key, const std::string& path) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    auto range = std::dynamic_pointer_cast<range_partitioner>(partitioner_);
+    if (!range) {
+        throw std::runtime_error("only range partitioned shards can be split");
+    }
+    for (const auto& spec : dbs_) {
+        // the cursor moves keys in database order, the partitioner bounds them in byte order
+        if (spec.compare || (spec.flags & (MDB_INTEGERKEY | MDB_REVERSEKEY))) {
+            throw std::runtime_error("split requires databases in key byte order");
+        }
+    }
+    auto next = std::make_shared<range_partitioner>(*range);
+    next->split(index, key);
+
+    auto target = std::make_unique<shard>(factory_.open(path, mode_), dbs_);
+    std::string split_key(static_cast<const char*>(key.mv_data), key.mv_size);
+
+    // runs on the writer thread of the source shard, so queued writes are
+    // applied before the move and new ones wait for the routing lock
+    bool copied = false;
+    auto moved = shards_[index]->submit_alone([&](write_txn& txn, const std::vector<dbi>& dbis) {
+        write_txn out(target->environment().handle());
+        for (size_t i = 0; i < dbis.size(); ++i) {
+            unsigned int append = (dbs_[i].flags & MDB_DUPSORT)? MDB_APPENDDUP : MDB_APPEND;
+            MDB_cursor *cur;
+            if (mdb_cursor_open(txn.handle(), dbis[i].handle(), &cur)) {
+                throw std::runtime_error("failed to open cursor");
+            }
+            std::unique_ptr<MDB_cursor, void(*)(MDB_cursor*)> guard(cur, mdb_cursor_close);
+
+            MDB_val k{split_key.size(), split_key.data()}, d;
+            int err = mdb_cursor_get(cur, &k, &d, MDB_SET_RANGE);
+            while (!err) {
+                if (mdb_put(out.handle(), target->db(i).handle(), &k, &d, append)) {
+                    throw std::runtime_error("failed to move value");
+                }
+                dbi::filter_put(out.handle(), target->db(i).handle(), k);
+                if (mdb_cursor_del(cur, 0)) {
+                    throw std::runtime_error("failed to delete value");
+                }
+                dbi::filter_del(txn.handle(), dbis[i].handle());
+                err = mdb_cursor_get(cur, &k, &d, MDB_NEXT);
+            }
+            if (err != MDB_NOTFOUND) {
+                throw std::runtime_error("cursor error");
+            }
+        }
+        out.commit();
+        copied = true;
+    });
+    try {
+        moved.get();
+    } catch (...) {
+        if (copied) {
+            // the source kept its keys, so the new shard must not keep copies
+            try {
+                write_txn out(target->environment().handle());
+                for (size_t i = 0; i < dbs_.size(); ++i) {
+                    if (mdb_drop(out.handle(), target->db(i).handle(), 0)) {
+                        throw std::runtime_error("failed to empty db");
+                    }
+                }
+                out.commit();
+            } catch (...) {
+                throw std::runtime_error("split failed, the moved keys are left in " + path);
+            }
+        }
+        throw;
+    }
+
+    partitioner_ = next;
+    shards_.insert(shards_.begin() + index + 1, std::move(target));
+}
+
+
+sharded_env::factory::factory(env::factory f):env_factory_{f} {
+
+}
+
+sharded_env::factory& sharded_env::factory::add_shard(const std::string& path) {
+    paths_.push_back(path);
+    return *this;
+}
+
+sharded_env::factory& sharded_env::factory::add_db(const std::string& name, unsigned int flags, MDB_cmp_func* compare, MDB_cmp_func* dupsort) {
+    dbs_.push_back(db_spec{name, flags, compare, dupsort});
+    return *this;
+}
+
+sharded_env::factory& sharded_env::factory::set_partitioner(std::shared_ptr<partitioner> p) {
+    partitioner_ = p;
+    return *this;
+}
+
+sharded_env sharded_env::factory::open(mdb_mode_t mode) {
+    if (paths_.empty()) {
+        throw std::runtime_error("no shards");
+    }
+    auto p = partitioner_? partitioner_ : std::make_shared<hash_partitioner>(paths_.size());
+    if (p->size() != paths_.size()) {
+        throw std::runtime_error("partitioner does not match shard count");
+    }
+
+    std::vector<std::unique_ptr<shard>> shards;
+    for (const auto& path : paths_) {
+        shards.push_back(std::make_unique<shard>(env_factory_.open(path, mode), dbs_));
+    }
+    return sharded_env(env_factory_, mode, std::move(shards), p, dbs_);
+}
+
+}
@@ -0,0 +1,342 @@
+#include "lmdb-wrapper/time_series.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace lmdb {
+
+namespace {
+
+constexpr size_t key_size = 16;
+constexpr size_t header_size = 2 * sizeof(uint32_t);
+
+std::string make_key(uint64_t series, int64_t start) {
+    // flipping the sign bit makes negative times sort first
+    uint64_t time = static_cast<uint64_t>(start) ^ (uint64_t(1) << 63);
+    std::string key(key_size, '\0');
+    for (int i = 0; i < 8; ++i) {
+        key[i] = static_cast<char>(series >> (56 - 8 * i));
+        key[8 + i] = static_cast<char>(time >> (56 - 8 * i));
+    }
+    return key;
+}
+
+uint64_t key_series(const MDB_val& key) {
+    auto in = static_cast<const unsigned char*>(key.mv_data);
+    uint64_t series = 0;
+    for (int i = 0; i < 8; ++i) {
+        series = (series << 8) | in[i];
+    }
+    return series;
+}
+
+void put_varint(std::vector<unsigned char>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<unsigned char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+uint64_t get_varint(const unsigned char*& in) {
+    uint64_t v = 0;
+    for (int shift = 0; ; shift += 7) {
+        unsigned char b = *in++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+    }
+}
+
+uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+class cursor_guard {
+public:
+    cursor_guard(MDB_txn* txn, MDB_dbi db) {
+        if (mdb_cursor_open(txn, db, &cursor_)) {
+            throw std::runtime_error("failed to open cursor");
+        }
+    }
+    ~cursor_guard() {
+        mdb_cursor_close(cursor_);
+    }
+    MDB_cursor* get() const {
+        return cursor_;
+    }
+private:
+    MDB_cursor *cursor_;
+};
+
+}
+
+void time_series::block::add(int64_t time, double value) {
+    if (count_ && time <= last_time_) {
+        throw std::runtime_error("samples out of order");
+    }
+    if (!count_) {
+        start_ = time;
+    }
+    int64_t delta = time - last_time_;
+    put_varint(times_, zigzag(delta - last_delta_));
+    last_delta_ = delta;
+    last_time_ = time;
+
+    // control byte holds the zero bytes on each side of the XOR, followed by the bytes in between
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint64_t x = bits ^ last_bits_;
+    last_bits_ = bits;
+    unsigned int lead = 0, trail = 0;
+    if (!x) {
+        lead = 8;
+    } else {
+        while (!(x >> (56 - 8 * lead) & 0xff)) {
+            ++lead;
+        }
+        while (!(x >> (8 * trail) & 0xff)) {
+            ++trail;
+        }
+    }
+    values_.push_back(static_cast<unsigned char>(lead << 4 | trail));
+    x >>= 8 * trail;
+    for (unsigned int i = 0; i < 8 - lead - trail; ++i, x >>= 8) {
+        values_.push_back(static_cast<unsigned char>(x));
+    }
+    ++count_;
+}
+
+size_t time_series::block::size() const {
+    return count_;
+}
+
+int64_t time_series::block::start() const {
+    return start_;
+}
+
+int64_t time_series::block::last() const {
+    return last_time_;
+}
+
+std::vector<unsigned char> time_series::block::encode() const {
+    std::vector<unsigned char> out(header_size);
+    uint32_t times_size = static_cast<uint32_t>(times_.size());
+    std::memcpy(out.data(), &count_, sizeof(count_));
+    std::memcpy(out.data() + sizeof(count_), &times_size, sizeof(times_size));
+    out.reserve(header_size + times_.size() + values_.size());
+    out.insert(out.end(), times_.begin(), times_.end());
+    out.insert(out.end(), values_.begin(), values_.end());
+    return out;
+}
+
+void time_series::block::decode(const MDB_val& data, int64_t from, int64_t to, samples& out) {
+    if (data.mv_size < header_size) {
+        throw std::runtime_error("corrupted block");
+    }
+    auto in = static_cast<const unsigned char*>(data.mv_data);
+    uint32_t count, times_size;
+    std::memcpy(&count, in, sizeof(count));
+    std::memcpy(&times_size, in + sizeof(count), sizeof(times_size));
+    if (header_size + times_size > data.mv_size) {
+        throw std::runtime_error("corrupted block");
+    }
+
+    // decode both columns fully, then select the range with a single pass
+    std::vector<int64_t> times(count);
+    std::vector<double> values(count);
+    const unsigned char *t = in + header_size;
+    int64_t time = 0, delta = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        delta += unzigzag(get_varint(t));
+        time += delta;
+        times[i] = time;
+    }
+    const unsigned char *v = in + header_size + times_size;
+    uint64_t bits = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        unsigned int lead = *v >> 4, trail = *v & 0xf;
+        ++v;
+        uint64_t x = 0;
+        for (unsigned int j = 0; j < 8 - lead - trail; ++j) {
+            x |= uint64_t(v[j]) << (8 * j);
+        }
+        v += 8 - lead - trail;
+        bits ^= x << (8 * trail);
+        std::memcpy(&values[i], &bits, sizeof(bits));
+    }
+
+    auto first = std::lower_bound(times.begin(), times.end(), from) - times.begin();
+    auto last = std::lower_bound(times.begin(), times.end(), to) - times.begin();
+    out.time.insert(out.time.end(), times.begin() + first, times.begin() + last);
+    out.value.insert(out.value.end(), values.begin() + first, values.begin() + last);
+}
+
+
+time_series::time_series(const dbi& db, size_t block_samples):db_{db}, block_samples_{block_samples} {
+    if (!block_samples_) {
+        throw std::runtime_error("invalid block size");
+    }
+}
+
+const dbi& time_series::db() const {
+    return db_;
+}
+
+void time_series::append(write_txn& txn, uint64_t series, int64_t time, double value) {
+    track(txn, series);
+    auto& open = open_[series];
+    open.samples.add(time, value);
+    if (open.samples.size() >= block_samples_) {
+        write(txn, series, open);
+        open_.erase(series);
+    }
+}
+
+void time_series::flush(write_txn& txn) {
+    for (auto& [series, open] : open_) {
+        track(txn, series);
+        write(txn, series, open);
+    }
+}
+
+void time_series::track(write_txn& txn, uint64_t series) {
+    if (active_ != txn.handle()) {
+        if (active_) {
+            throw std::runtime_error("time series used by two transactions");
+        }
+        active_ = txn.handle();
+        saved_last_key_ = last_key_;
+        txn.on_end([this](bool committed) {
+            if (!committed) {
+                for (auto& [series, open] : saved_) {
+                    if (open) {
+                        open_[series] = std::move(*open);
+                    } else {
+                        open_.erase(series);
+                    }
+                }
+                last_key_ = std::move(saved_last_key_);
+            }
+            saved_.clear();
+            saved_last_key_.reset();
+            active_ = nullptr;
+        });
+    }
+    if (!saved_.count(series)) {
+        auto it = open_.find(series);
+        saved_.emplace(series, it == open_.end()? std::nullopt : std::optional<open_block>(it->second));
+    }
+}
+
+void time_series::write(write_txn& txn, uint64_t series, open_block& open) {
+    if (!last_key_) {
+        cursor_guard cur(txn.handle(), db_.handle());
+        MDB_val key, data;
+        int err = mdb_cursor_get(cur.get(), &key, &data, MDB_LAST);
+        last_key_ = err? std::string() : std::string(static_cast<const char*>(key.mv_data), key.mv_size);
+    }
+
+    std::string key = make_key(series, open.samples.start());
+    auto encoded = open.samples.encode();
+    MDB_val k{key.size(), key.data()};
+    MDB_val data{encoded.size(), encoded.data()};
+    bool append = !open.stored && key > *last_key_;
+    auto err = mdb_put(txn.handle(), db_.handle(), &k, &data, append? MDB_APPEND : 0);
+    if (err == MDB_KEYEXIST && append) {
+        // another writer added larger keys since the last one was read
+        last_key_.reset();
+        err = mdb_put(txn.handle(), db_.handle(), &k, &data, 0);
+    }
+    switch (err) {
+        case 0:
+            dbi::filter_put(txn.handle(), db_.handle(), k);
+            break;
+        case MDB_MAP_FULL:
+            throw std::runtime_error("db is full");
+        case MDB_TXN_FULL:
+            throw std::runtime_error("txn has too many dirty pages");
+        default:
+            throw std::runtime_error("failed to put value");
+    }
+    if (last_key_ && key > *last_key_) {
+        last_key_ = key;
+    }
+    open.stored = true;
+}
+
+time_series::samples time_series::range(txn_base& txn, uint64_t series, int64_t from, int64_t to) const {
+    samples result;
+    auto open = open_.find(series);
+    std::optional<std::string> open_key;
+    if (open != open_.end()) {
+        open_key = make_key(series, open->second.samples.start());
+    }
+
+    cursor_guard cur(txn.handle(), db_.handle());
+    std::string start = make_key(series, from);
+    MDB_val key{start.size(), start.data()}, data;
+
+    // the block starting before from may still hold samples in the range
+    int err = mdb_cursor_get(cur.get(), &key, &data, MDB_SET_RANGE);
+    if (!err && std::memcmp(key.mv_data, start.data(), key_size)) {
+        err = mdb_cursor_get(cur.get(), &key, &data, MDB_PREV);
+        if (err || key_series(key) != series) {
+            err = mdb_cursor_get(cur.get(), &key, &data, err? MDB_FIRST : MDB_NEXT);
+        }
+    } else if (err == MDB_NOTFOUND) {
+        err = mdb_cursor_get(cur.get(), &key, &data, MDB_LAST);
+    }
+
+    std::string end = make_key(series, to);
+    while (!err && key.mv_size == key_size && std::memcmp(key.mv_data, end.data(), key_size) < 0) {
+        bool buffered = open_key && !std::memcmp(key.mv_data, open_key->data(), key_size);
+        if (key_series(key) == series && !buffered) {
+            block::decode(data, from, to, result);
+        }
+        err = mdb_cursor_get(cur.get(), &key, &data, MDB_NEXT);
+    }
+    if (err && err != MDB_NOTFOUND) {
+        throw std::runtime_error("cursor error");
+    }
+
+    if (open != open_.end() && open->second.samples.last() >= from && open->second.samples.start() < to) {
+        auto encoded = open->second.samples.encode();
+        block::decode(MDB_val{encoded.size(), encoded.data()}, from, to, result);
+    }
+    return result;
+}
+
+std::vector<time_series::bucket> time_series::downsample(txn_base& txn, uint64_t series, int64_t from, int64_t to, int64_t width) const {
+    if (width <= 0) {
+        throw std::runtime_error("invalid bucket width");
+    }
+    auto data = range(txn, series, from, to);
+    std::vector<bucket> result;
+    size_t i = 0;
+    while (i < data.time.size()) {
+        int64_t start = from + (data.time[i] - from) / width * width;
+        int64_t end = start + width;
+        size_t j = i;
+        while (j < data.time.size() && data.time[j] < end) {
+            ++j;
+        }
+        bucket b{start, j - i, std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(), 0};
+        for (size_t k = i; k < j; ++k) {
+            b.min = std::min(b.min, data.value[k]);
+            b.max = std::max(b.max, data.value[k]);
+            b.sum += data.value[k];
+        }
+        result.push_back(b);
+        i = j;
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,226 @@
+#include "lmdb-wrapper/trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+namespace lmdb {
+
+namespace {
+
+constexpr char magic[8] = {'L', 'M', 'D', 'B', 'T', 'R', 'C', '1'};
+
+void put_varint(std::vector<unsigned char>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<unsigned char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(v));
+}
+
+bool get_varint(std::istream& in, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == EOF) {
+            return false;
+        }
+        v |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    throw std::runtime_error("corrupted trace");
+}
+
+uint64_t hash_key(const MDB_val& key) {
+    uint64_t h = 14695981039346656037ULL;
+    auto p = static_cast<const unsigned char*>(key.mv_data);
+    for (size_t i = 0; i < key.mv_size; ++i) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+uint32_t thread_number() {
+    static std::atomic<uint32_t> next{0};
+    thread_local uint32_t number = next++;
+    return number;
+}
+
+std::mutex retired_mutex;
+
+// the running recorder and the replaced ones not freed yet
+std::vector<std::unique_ptr<trace_recorder>>& recorders() {
+    static std::vector<std::unique_ptr<trace_recorder>> recorders;
+    return recorders;
+}
+
+}
+
+trace_recorder::trace_recorder(const std::string& path, const options& opts):
+    options_{opts}, origin_{now()}, out_{path, std::ios::binary | std::ios::trunc}, closed_{false} {
+
+    if (!out_) {
+        throw std::runtime_error("failed to open trace");
+    }
+    out_.write(magic, sizeof(magic));
+    buffer_.reserve(options_.buffer_size + 256);
+}
+
+void trace_recorder::start(const std::string& path) {
+    start(path, options());
+}
+
+void trace_recorder::start(const std::string& path, const options& opts) {
+    std::unique_ptr<trace_recorder> recorder(new trace_recorder(path, opts));
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        auto previous = active_.exchange(recorder.get());
+        recorders().push_back(std::move(recorder));
+        if (previous) {
+            previous->close();
+            retired_ = true;
+        }
+    }
+    reclaim();
+}
+
+void trace_recorder::stop() {
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        if (auto previous = active_.exchange(nullptr)) {
+            previous->close();
+            retired_ = true;
+        }
+    }
+    reclaim();
+}
+
+void trace_recorder::reclaim() {
+    std::lock_guard<std::mutex> lock(retired_mutex);
+    // operations acquiring from now on get the running recorder, the last
+    // holder of a replaced one calls reclaim again
+    if (!retired_ || holders_.load()) {
+        return;
+    }
+    auto running = active_.load();
+    auto& list = recorders();
+    list.erase(std::remove_if(list.begin(), list.end(), [&](const auto& r) { return r.get() != running; }), list.end());
+    retired_ = false;
+}
+
+uint64_t trace_recorder::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void trace_recorder::record(op kind, int err, uint64_t start, MDB_dbi dbi, unsigned int flags, const MDB_val* key, size_t value_size) {
+    uint64_t end = now();
+    thread_local std::vector<unsigned char> encoded;
+    encoded.clear();
+    encoded.push_back(static_cast<unsigned char>(kind));
+    encoded.push_back(static_cast<unsigned char>(!err? status::ok : err == MDB_NOTFOUND? status::not_found : status::error));
+    put_varint(encoded, thread_number());
+    put_varint(encoded, start > origin_? start - origin_ : 0);
+    put_varint(encoded, end - start);
+    put_varint(encoded, dbi);
+    put_varint(encoded, flags);
+    if (!key) {
+        encoded.push_back(static_cast<unsigned char>(key_mode::none));
+    } else if (options_.keys == key_mode::full || kind == op::dbi_open) {
+        encoded.push_back(static_cast<unsigned char>(key_mode::full));
+        put_varint(encoded, key->mv_size);
+        auto p = static_cast<const unsigned char*>(key->mv_data);
+        encoded.insert(encoded.end(), p, p + key->mv_size);
+    } else {
+        encoded.push_back(static_cast<unsigned char>(key_mode::hash));
+        uint64_t h = hash_key(*key);
+        auto p = reinterpret_cast<const unsigned char*>(&h);
+        encoded.insert(encoded.end(), p, p + sizeof(h));
+    }
+    put_varint(encoded, value_size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_) {
+        return;
+    }
+    buffer_.insert(buffer_.end(), encoded.begin(), encoded.end());
+    if (buffer_.size() >= options_.buffer_size) {
+        flush();
+    }
+}
+
+void trace_recorder::describe(MDB_dbi dbi, const char* name, unsigned int flags) {
+    if (auto recorder = acquire()) {
+        MDB_val key{name? std::strlen(name) : 0, const_cast<char*>(name)};
+        recorder->record(op::dbi_open, 0, now(), dbi, flags, name? &key : nullptr, 0);
+        release();
+    }
+}
+
+void trace_recorder::flush() {
+    out_.write(reinterpret_cast<const char*>(buffer_.data()), buffer_.size());
+    buffer_.clear();
+}
+
+void trace_recorder::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!closed_) {
+        flush();
+        out_.close();
+        closed_ = true;
+    }
+}
+
+
+trace_reader::trace_reader(const std::string& path):in_{path, std::ios::binary} {
+    char header[sizeof(magic)];
+    if (!in_.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic))) {
+        throw std::runtime_error("invalid trace");
+    }
+}
+
+std::optional<trace_record> trace_reader::next() {
+    int kind = in_.get();
+    if (kind == EOF) {
+        return std::nullopt;
+    }
+    trace_record result;
+    result.kind = static_cast<trace_recorder::op>(kind);
+    result.result = static_cast<trace_recorder::status>(in_.get());
+    uint64_t thread, dbi, flags, size;
+    if (!get_varint(in_, thread) || !get_varint(in_, result.start) || !get_varint(in_, result.duration)
+        || !get_varint(in_, dbi) || !get_varint(in_, flags)) {
+        throw std::runtime_error("corrupted trace");
+    }
+    result.thread = static_cast<uint32_t>(thread);
+    result.dbi = static_cast<MDB_dbi>(dbi);
+    result.flags = static_cast<unsigned int>(flags);
+    result.keys = static_cast<trace_recorder::key_mode>(in_.get());
+    result.key_hash = 0;
+    switch (result.keys) {
+        case trace_recorder::key_mode::none:
+            break;
+        case trace_recorder::key_mode::full:
+            if (!get_varint(in_, size)) {
+                throw std::runtime_error("corrupted trace");
+            }
+            result.key.resize(size);
+            in_.read(result.key.data(), size);
+            break;
+        case trace_recorder::key_mode::hash:
+            in_.read(reinterpret_cast<char*>(&result.key_hash), sizeof(result.key_hash));
+            break;
+        default:
+            throw std::runtime_error("corrupted trace");
+    }
+    if (!get_varint(in_, size) || !in_) {
+        throw std::runtime_error("corrupted trace");
+    }
+    result.value_size = size;
+    return result;
+}
+
+}
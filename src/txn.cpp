@@ -1,4 +1,6 @@
 #include "lmdb-wrapper/txn.hpp"
+#include "lmdb-wrapper/change_log.hpp"
+#include "lmdb-wrapper/env_context.hpp"
 
 namespace lmdb {
 
@@ -14,12 +16,113 @@ write_txn::write_txn(MDB_env* env): txn<write_txn>(env, 0) {
 
 }
 
-write_txn::write_txn(MDB_env* env, MDB_txn* parent): txn<write_txn>(env, parent, 0) {
+write_txn::write_txn(MDB_env* env, MDB_txn* parent): txn<write_txn>(env, parent, 0), nested_{parent != nullptr} {
 
 }
 
+write_txn::~write_txn() {
+    if (txn_) {
+        ended(false);
+    }
+}
+
+write_txn& write_txn::operator=(write_txn&& other) {
+    if (txn_) {
+        ended(false);
+    }
+    txn<write_txn>::operator=(std::move(other));
+    log_ = other.log_;
+    seq_ = other.seq_;
+    nested_ = other.nested_;
+    parent_ = other.parent_;
+    on_end_ = std::move(other.on_end_);
+    other.on_end_.clear();
+    return *this;
+}
+
 write_txn write_txn::nested_write() {
-    return write_txn(mdb_txn_env(txn_), txn_);
+    write_txn result(mdb_txn_env(txn_), txn_);
+    result.parent_ = this;
+    // a nested transaction has the id of its parent, the records follow on
+    result.log_ = log_;
+    result.seq_ = seq_;
+    return result;
+}
+
+write_txn& write_txn::on_end(std::function<void(bool)> f) {
+    on_end_.push_back(std::move(f));
+    return *this;
+}
+
+write_txn& write_txn::log_changes(change_log& log) {
+    log_ = &log;
+    return *this;
+}
+
+write_txn& write_txn::commit() {
+    bool logged = log_ && seq_ && !nested_;
+    auto context = env_context::of(mdb_txn_env(txn_));
+    uint64_t txnid = mdb_txn_id(txn_);
+    bool top = context && !nested_;
+    if (top) {
+        context->registry().committing(txnid);
+    }
+    try {
+        txn<write_txn>::commit();
+    } catch (...) {
+        if (top) {
+            context->registry().abandoned(txnid);
+        }
+        ended(false);
+        throw;
+    }
+    if (top) {
+        context->registry().committed(txnid);
+    }
+    if (nested_ && parent_) {
+        parent_->seq_ = seq_;
+    }
+    if (logged) {
+        log_->notify();
+    }
+    if (top && context->flusher()) {
+        context->flusher()->committed();
+    }
+    ended(true);
+    return *this;
+}
+
+write_txn& write_txn::abort() {
+    txn<write_txn>::abort();
+    ended(false);
+    return *this;
+}
+
+void write_txn::ended(bool committed) {
+    auto callbacks = std::move(on_end_);
+    on_end_.clear();
+    if (committed && parent_) {
+        // the parent commits or aborts the changes
+        for (auto& f : callbacks) {
+            parent_->on_end_.push_back(std::move(f));
+        }
+        return;
+    }
+    for (auto& f : callbacks) {
+        f(committed);
+    }
+}
+
+void write_txn::log_put(const dbi& db, const MDB_val& key) {
+    if (log_) {
+        log_->append(txn_, seq_++, change::op::put, db, key);
+    }
+}
+
+void write_txn::log_del(const dbi& db, const MDB_val& key) {
+    if (log_) {
+        log_->append(txn_, seq_++, change::op::del, db, key);
+    }
 }
 
 }
\ No newline at end of file
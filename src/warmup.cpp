@@ -0,0 +1,372 @@
+#include "lmdb-wrapper/warmup.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lmdb {
+
+namespace {
+
+constexpr char magic[8] = {'L', 'M', 'D', 'B', 'H', 'O', 'T', '1'};
+constexpr uint64_t chunk_size = 8 << 20;
+constexpr size_t merge_gap = 16;
+
+// on-disk layout of LMDB 0.9 on 64 bit little endian machines, see mdb.c
+static_assert(sizeof(size_t) == 8, "the page walk reads the 64 bit format");
+constexpr size_t page_header_size = 16;
+constexpr uint16_t page_branch = 0x01;
+constexpr uint64_t invalid_page = ~uint64_t(0);
+constexpr uint32_t meta_magic = 0xBEEFC0DE;
+constexpr uint32_t meta_version = 1;
+constexpr int layout_major = 0;
+constexpr int layout_minor = 9;
+
+struct db_record {
+    uint32_t pad;
+    uint16_t flags;
+    uint16_t depth;
+    uint64_t branch_pages;
+    uint64_t leaf_pages;
+    uint64_t overflow_pages;
+    uint64_t entries;
+    uint64_t root;
+};
+
+struct meta_record {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t address;
+    uint64_t map_size;
+    db_record dbs[2];
+    uint64_t last_page;
+    uint64_t txnid;
+};
+
+template <class T>
+T read(const char* p) {
+    T result;
+    std::memcpy(&result, p, sizeof(T));
+    return result;
+}
+
+void will_need(const char* addr, size_t length) {
+#ifndef _WIN32
+    posix_madvise(const_cast<char*>(addr), length, POSIX_MADV_WILLNEED);
+#endif
+}
+
+uint64_t file_size(MDB_env* env) {
+#ifndef _WIN32
+    mdb_filehandle_t fd;
+    struct stat st;
+    if (!mdb_env_get_fd(env, &fd) && !fstat(fd, &st)) {
+        return st.st_size;
+    }
+#endif
+    return 0;
+}
+
+bool known_format(const char* map, size_t page_size) {
+    // the data file of another release may keep the meta version while the
+    // structures behind it change, so the library has to match as well
+    int major, minor, patch;
+    mdb_version(&major, &minor, &patch);
+    if (major != layout_major || minor != layout_minor) {
+        return false;
+    }
+    for (size_t page = 0; page < 2; ++page) {
+        meta_record m = read<meta_record>(map + page * page_size + page_header_size);
+        if (m.magic != meta_magic || m.version != meta_version) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+    Root and depth of a database as of the snapshot of txn.
+    @return nothing if the database does not exist or the format is not the expected one
+*/
+std::optional<db_record> find_db(MDB_txn* txn, const char* map, size_t page_size, const std::string& name) {
+    if (name.empty()) {
+        // main database, from the meta page of the snapshot, the writer
+        // only rewrites the other one
+        uint64_t txnid = mdb_txn_id(txn);
+        for (size_t page = 0; page < 2; ++page) {
+            meta_record m = read<meta_record>(map + page * page_size + page_header_size);
+            if (m.txnid == txnid) {
+                return m.dbs[1];
+            }
+        }
+        return std::nullopt;
+    }
+    MDB_dbi main;
+    if (mdb_dbi_open(txn, nullptr, 0, &main)) {
+        throw std::runtime_error("failed to open dbi");
+    }
+    MDB_val key{name.size(), const_cast<char*>(name.data())}, data;
+    switch (mdb_get(txn, main, &key, &data)) {
+        case 0:
+            break;
+        case MDB_NOTFOUND:
+            return std::nullopt;
+        default:
+            throw std::runtime_error("failed to get value");
+    }
+    if (data.mv_size != sizeof(db_record)) {
+        return std::nullopt;
+    }
+    return read<db_record>(static_cast<const char*>(data.mv_data));
+}
+
+}
+
+page_profile page_profile::record(MDB_env* env) {
+    page_profile result;
+#ifndef _WIN32
+    MDB_envinfo info;
+    MDB_stat st;
+    if (mdb_env_info(env, &info) || mdb_env_stat(env, &st)) {
+        throw std::runtime_error("failed to get env info");
+    }
+    size_t os_page = sysconf(_SC_PAGESIZE);
+    size_t length = std::min<size_t>(info.me_mapsize, (info.me_last_pgno + 1) * st.ms_psize);
+    length = std::min<size_t>(length, file_size(env));
+    size_t pages = (length + os_page - 1) / os_page;
+#ifdef __linux__
+    std::vector<unsigned char> resident(pages);
+#else
+    std::vector<char> resident(pages);
+#endif
+    if (pages && mincore(info.me_mapaddr, length, resident.data())) {
+        throw std::runtime_error("failed to get resident pages");
+    }
+    size_t gap = 0;
+    for (size_t i = 0; i < pages; ++i) {
+        if (!(resident[i] & 1)) {
+            ++gap;
+            continue;
+        }
+        uint64_t offset = i * os_page;
+        if (!result.extents_.empty() && gap <= merge_gap) {
+            auto& last = result.extents_.back();
+            last.length = offset + os_page - last.offset;
+        } else {
+            result.extents_.push_back(extent{offset, os_page});
+        }
+        gap = 0;
+    }
+#endif
+    return result;
+}
+
+std::optional<page_profile> page_profile::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char header[sizeof(magic)];
+    uint64_t count;
+    if (!in.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic))
+        || !in.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+        return std::nullopt;
+    }
+    // a truncated or corrupt file must not size the allocation
+    auto start = in.tellg();
+    in.seekg(0, std::ios::end);
+    auto end = in.tellg();
+    in.seekg(start);
+    if (start < 0 || end < start || count != static_cast<uint64_t>(end - start) / sizeof(extent)) {
+        return std::nullopt;
+    }
+    page_profile result;
+    result.extents_.resize(count);
+    if (!in.read(reinterpret_cast<char*>(result.extents_.data()), count * sizeof(extent))) {
+        return std::nullopt;
+    }
+    return result;
+}
+
+std::string page_profile::default_path(MDB_env* env) {
+    const char *path;
+    unsigned int flags;
+    if (mdb_env_get_path(env, &path) || mdb_env_get_flags(env, &flags)) {
+        throw std::runtime_error("invalid env");
+    }
+    return (flags & MDB_NOSUBDIR)? std::string(path) + "-hot-pages" : std::string(path) + "/hot-pages";
+}
+
+void page_profile::save(const std::string& path) const {
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        uint64_t count = extents_.size();
+        out.write(magic, sizeof(magic));
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        out.write(reinterpret_cast<const char*>(extents_.data()), count * sizeof(extent));
+        if (!out) {
+            throw std::runtime_error("failed to write page profile");
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str())) {
+        throw std::runtime_error("failed to write page profile");
+    }
+}
+
+size_t page_profile::prefetch(MDB_env* env, size_t max_bytes, unsigned int threads) const {
+    uint64_t size = file_size(env);
+    std::vector<extent> chunks;
+    for (const auto& e : extents_) {
+        uint64_t end = std::min(e.offset + e.length, size);
+        for (uint64_t offset = e.offset; offset < end; offset += chunk_size) {
+            chunks.push_back(extent{offset, std::min(chunk_size, end - offset)});
+        }
+    }
+
+    MDB_envinfo info;
+    mdb_filehandle_t fd;
+    if (mdb_env_info(env, &info) || mdb_env_get_fd(env, &fd)) {
+        throw std::runtime_error("failed to get env info");
+    }
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> budget{max_bytes};
+    std::atomic<size_t> done{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < chunks.size(); i = next++) {
+            size_t length = chunks[i].length;
+            size_t left = budget.load();
+            do {
+                if (!left) {
+                    return;
+                }
+            } while (!budget.compare_exchange_weak(left, left - std::min<size_t>(left, length)));
+            length = std::min<size_t>(left, length);
+#ifdef __linux__
+            // blocks until the data is in the page cache
+            readahead(fd, chunks[i].offset, length);
+#else
+            will_need(static_cast<const char*>(info.me_mapaddr) + chunks[i].offset, length);
+#endif
+            done += length;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned int t = 1; t < std::max(threads, 1u); ++t) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& w : workers) {
+        w.join();
+    }
+    return done;
+}
+
+const std::vector<page_profile::extent>& page_profile::extents() const {
+    return extents_;
+}
+
+size_t page_profile::bytes() const {
+    size_t result = 0;
+    for (const auto& e : extents_) {
+        result += e.length;
+    }
+    return result;
+}
+
+void warmup::run(MDB_env* env, const warmup_options& opts) {
+    // only an optimization, failures leave the cache cold
+    size_t budget = opts.max_bytes;
+    for (const auto& name : opts.branch_dbs) {
+        try {
+            budget -= std::min(budget, preload_branches(env, name, budget));
+        } catch (...) {
+        }
+    }
+    if (opts.profile && budget) {
+        try {
+            auto profile = page_profile::load(opts.path.empty()? page_profile::default_path(env) : opts.path);
+            if (profile) {
+                profile->prefetch(env, budget, opts.threads);
+            }
+        } catch (...) {
+        }
+    }
+}
+
+size_t warmup::preload_branches(MDB_env* env, const std::string& name, size_t max_bytes) {
+    MDB_envinfo info;
+    MDB_stat st;
+    if (mdb_env_info(env, &info) || mdb_env_stat(env, &st)) {
+        throw std::runtime_error("failed to get env info");
+    }
+    const char *map = static_cast<const char*>(info.me_mapaddr);
+    size_t page_size = st.ms_psize;
+    if (!known_format(map, page_size)) {
+        return 0;
+    }
+
+    // the snapshot keeps the pages from being reused while they are read
+    MDB_txn *txn;
+    if (mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn)) {
+        throw std::runtime_error("failed to begin transaction");
+    }
+    size_t bytes = 0;
+    try {
+        auto found = find_db(txn, map, page_size, name);
+        if (!found) {
+            mdb_txn_abort(txn);
+            return 0;
+        }
+        db_record db = *found;
+        MDB_envinfo current;
+        mdb_env_info(env, &current);
+        uint64_t last_page = current.me_last_pgno;
+
+        std::vector<uint64_t> level;
+        if (db.root != invalid_page) {
+            level.push_back(db.root);
+        }
+        // pages above the leaf level are branches
+        for (unsigned int depth = 1; depth < db.depth && !level.empty(); ++depth) {
+            size_t level_bytes = level.size() * page_size;
+            if (bytes + level_bytes > max_bytes) {
+                break;
+            }
+            for (auto page : level) {
+                will_need(map + page * page_size, page_size);
+            }
+            std::vector<uint64_t> children;
+            for (auto page : level) {
+                const char *p = map + page * page_size;
+                if (!(read<uint16_t>(p + 10) & page_branch)) {
+                    continue;
+                }
+                uint16_t lower = read<uint16_t>(p + 12);
+                for (size_t i = 0; page_header_size + 2 * i < lower; ++i) {
+                    const char *node = p + read<uint16_t>(p + page_header_size + 2 * i);
+                    uint64_t child = uint64_t(read<uint16_t>(node)) | uint64_t(read<uint16_t>(node + 2)) << 16 | uint64_t(read<uint16_t>(node + 4)) << 32;
+                    if (child <= last_page) {
+                        children.push_back(child);
+                    }
+                }
+            }
+            bytes += level_bytes;
+            level.swap(children);
+        }
+    } catch (...) {
+        mdb_txn_abort(txn);
+        throw;
+    }
+    mdb_txn_abort(txn);
+    return bytes;
+}
+
+}
@@ -0,0 +1,122 @@
+#include "lmdb-wrapper/write_batch.hpp"
+
+namespace lmdb {
+
+write_batch::write_batch(const env& e):env_{e}, snapshot_{e.handle()}, scanned_{false} {
+    snapshot_id_ = mdb_txn_id(snapshot_.handle());
+}
+
+write_batch::key_t write_batch::make_key(const dbi& db, const MDB_val& key) {
+    return key_t(db.handle(), std::string(static_cast<const char*>(key.mv_data), key.mv_size));
+}
+
+size_t write_batch::size() const {
+    return writes_.size();
+}
+
+write_batch& write_batch::log_changes(change_log& log) {
+    log_ = &log;
+    return *this;
+}
+
+std::optional<MDB_val> write_batch::lookup(const dbi& db, const MDB_val& key) {
+    auto k = make_key(db, key);
+    auto write = writes_.find(k);
+    if (write != writes_.end()) {
+        if (!write->second.value) {
+            return std::nullopt;
+        }
+        const auto& value = *write->second.value;
+        return MDB_val{value.size(), const_cast<char*>(value.data())};
+    }
+
+    MDB_val mdb_key = key, data;
+    int err = mdb_get(snapshot_.handle(), db.handle(), &mdb_key, &data);
+    switch (err) {
+        case 0:
+            reads_.emplace(std::move(k), std::string(static_cast<const char*>(data.mv_data), data.mv_size));
+            return data;
+        case MDB_NOTFOUND:
+            reads_.emplace(std::move(k), std::nullopt);
+            return std::nullopt;
+        default:
+            throw std::runtime_error("failed to get value");
+    }
+}
+
+void write_batch::commit() {
+    // a thread may not hold a read and a write transaction at the same time
+    snapshot_.abort();
+    try {
+        apply();
+    } catch (...) {
+        restart();
+        throw;
+    }
+    restart();
+}
+
+void write_batch::restart() {
+    writes_.clear();
+    reads_.clear();
+    scanned_ = false;
+    snapshot_ = read_txn(env_.handle());
+    snapshot_id_ = mdb_txn_id(snapshot_.handle());
+}
+
+void write_batch::apply() {
+    write_txn txn(env_.handle());
+    if (log_) {
+        txn.log_changes(*log_);
+    }
+    if (mdb_txn_id(txn.handle()) != snapshot_id_ + 1) {
+        if (scanned_) {
+            throw write_conflict("snapshot changed after scan");
+        }
+        for (const auto& [key, seen] : reads_) {
+            MDB_val mdb_key{key.second.size(), const_cast<char*>(key.second.data())}, data;
+            int err = mdb_get(txn.handle(), key.first, &mdb_key, &data);
+            if (err && err != MDB_NOTFOUND) {
+                throw std::runtime_error("failed to get value");
+            }
+            bool unchanged = err? !seen : seen && seen->size() == data.mv_size && !seen->compare(0, data.mv_size, static_cast<const char*>(data.mv_data), data.mv_size);
+            if (!unchanged) {
+                throw write_conflict("value changed after read");
+            }
+        }
+    }
+
+    for (const auto& [key, m] : writes_) {
+        if (m.value) {
+            MDB_val mdb_key{key.second.size(), const_cast<char*>(key.second.data())};
+            MDB_val data{m.value->size(), const_cast<char*>(m.value->data())};
+            switch (mdb_put(txn.handle(), key.first, &mdb_key, &data, m.flags)) {
+                case 0:
+                    dbi::filter_put(txn.handle(), key.first, mdb_key);
+                    txn.log_put(dbi(key.first), mdb_key);
+                    break;
+                case MDB_MAP_FULL:
+                    throw std::runtime_error("db is full");
+                case MDB_TXN_FULL:
+                    throw std::runtime_error("txn has too many dirty pages");
+                case MDB_KEYEXIST:
+                    throw std::runtime_error("key exists");
+                default:
+                    throw std::runtime_error("failed to put value");
+            }
+        } else {
+            MDB_val mdb_key{key.second.size(), const_cast<char*>(key.second.data())};
+            int err = mdb_del(txn.handle(), key.first, &mdb_key, nullptr);
+            if (err && err != MDB_NOTFOUND) {
+                throw std::runtime_error("failed to delete value");
+            }
+            if (!err) {
+                dbi::filter_del(txn.handle(), key.first);
+                txn.log_del(dbi(key.first), mdb_key);
+            }
+        }
+    }
+    txn.commit();
+}
+
+}
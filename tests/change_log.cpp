@@ -0,0 +1,87 @@
+#include "test.hpp"
+#include "lmdb-wrapper/change_log.hpp"
+#include "lmdb-wrapper/write_batch.hpp"
+
+using namespace lmdb;
+
+int main() {
+    test::run("names", []() {
+        test::temp_dir dir;
+        {
+            auto e = test::open_env(dir.path());
+            change_log log(e);
+            write_txn t(e.handle());
+            t.log_changes(log);
+            dbi a = t.db().set(dbi::flags::create).open("a");
+            dbi b = t.db().set(dbi::flags::create).open("b");
+            t.put<std::string>(b, std::string("k1"), std::string("v"), 0);
+            t.put<std::string>(a, std::string("k2"), std::string("v"), 0);
+            t.del(a, std::string("k2"));
+            t.commit();
+        }
+        // handles are assigned anew, the records still name their databases
+        auto e = test::open_env(dir.path());
+        change_log log(e);
+        change_reader reader(log);
+        auto changes = reader.poll(10);
+        CHECK(changes.size() == 3);
+        CHECK(changes[0].db == "b" && changes[0].kind == change::op::put && changes[0].key == "k1");
+        CHECK(changes[1].db == "a" && changes[1].kind == change::op::put && changes[1].key == "k2");
+        CHECK(changes[2].db == "a" && changes[2].kind == change::op::del && changes[2].key == "k2");
+        CHECK(changes[2].pos.seq == 2);
+    });
+    test::run("nested transactions", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        change_log log(e);
+        write_txn t(e.handle());
+        t.log_changes(log);
+        dbi a = t.db().set(dbi::flags::create).open("a");
+        t.put<std::string>(a, std::string("k1"), std::string("v"), 0);
+        {
+            auto nested = t.nested_write();
+            nested.put<std::string>(a, std::string("k2"), std::string("v"), 0);
+            nested.commit();
+        }
+        {
+            auto nested = t.nested_write();
+            nested.put<std::string>(a, std::string("dropped"), std::string("v"), 0);
+            nested.abort();
+        }
+        t.put<std::string>(a, std::string("k3"), std::string("v"), 0);
+        t.commit();
+
+        change_reader reader(log);
+        auto changes = reader.poll(10);
+        CHECK(changes.size() == 3);
+        CHECK(changes[0].key == "k1" && changes[1].key == "k2" && changes[2].key == "k3");
+        CHECK(changes[1].pos.seq == 1 && changes[2].pos.seq == 2);
+    });
+
+    test::run("write_batch", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        change_log log(e);
+        dbi a;
+        {
+            write_txn t(e.handle());
+            a = t.db().set(dbi::flags::create).open("a");
+            t.put<std::string>(a, std::string("old"), std::string("v"), 0);
+            t.commit();
+        }
+        change_reader reader(log);
+        uint32_t seen = log.sequence();
+        write_batch batch(e);
+        batch.log_changes(log);
+        batch.put(a, std::string("new"), std::string("v"));
+        batch.del(a, std::string("old"));
+        batch.commit();
+        CHECK(log.sequence() != seen);
+
+        auto changes = reader.poll(10);
+        CHECK(changes.size() == 2);
+        CHECK(changes[0].kind == change::op::put && changes[0].key == "new" && changes[0].db == "a");
+        CHECK(changes[1].kind == change::op::del && changes[1].key == "old");
+    });
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include "test.hpp"
+#include "lmdb-wrapper/comparator.hpp"
+#include "lmdb-wrapper/db_iterator.hpp"
+
+#include <algorithm>
+#include <random>
+
+using namespace lmdb;
+
+namespace {
+
+// id, newest time first, then name
+using layout = composite<big_endian<4>, descending<big_endian<8>>, length_prefixed<2>>;
+
+std::string encode(uint32_t id, uint64_t time, const std::string& name) {
+    std::string key;
+    for (int i = 3; i >= 0; --i) {
+        key.push_back(static_cast<char>(id >> (8 * i)));
+    }
+    for (int i = 7; i >= 0; --i) {
+        key.push_back(static_cast<char>(time >> (8 * i)));
+    }
+    key.push_back(static_cast<char>(name.size() >> 8));
+    key.push_back(static_cast<char>(name.size()));
+    return key + name;
+}
+
+MDB_val val(const std::string& s) {
+    return MDB_val{s.size(), const_cast<char*>(s.data())};
+}
+
+int compare(const std::string& a, const std::string& b) {
+    MDB_val va = val(a), vb = val(b);
+    return layout::compare(&va, &vb);
+}
+
+std::vector<std::string> keys(size_t count, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::vector<std::string> names = {"", "a", "ab", "b", "\xff", std::string(1, '\0')};
+    std::vector<uint64_t> times = {0, 1, 0x80, 0xff, uint64_t(1) << 63, ~uint64_t(0)};
+    std::vector<std::string> result;
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back(encode(gen() % 4, times[gen() % times.size()], names[gen() % names.size()]));
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+dbi fill(env& e, const std::string& name, const std::vector<std::string>& keys) {
+    write_txn t(e.handle());
+    dbi db = t.db().set(dbi::flags::create).set_compare<layout>().open(name);
+    for (const auto& key : keys) {
+        t.put<std::string>(db, key, key, 0);
+    }
+    t.commit();
+    return db;
+}
+
+std::vector<std::string> scan(env& e, const std::vector<dbi>& dbis, const key_range& r) {
+    read_txn t(e.handle());
+    std::vector<std::string> result;
+    for (const auto& [key, value] : range(db_iterator<std::string, std::string>(t, dbis, r))) {
+        CHECK(key == value);
+        result.push_back(key);
+    }
+    return result;
+}
+
+}
+
+int main() {
+    test::run("sign of columns", []() {
+        unsigned char low = 0x00, high = 0xff;
+        CHECK(compare_bytes(&low, 1, &high, 1) == -1);
+        CHECK(compare_bytes(&high, 1, &low, 1) == 1);
+        CHECK(compare_bytes(&low, 0, &low, 1) == -1);
+        CHECK(compare_bytes(&low, 1, &low, 1) == 0);
+        CHECK(compare(encode(1, 5, "a"), encode(1, 4, "a")) == -1);
+        CHECK(compare(encode(1, 0, "a"), encode(1, ~uint64_t(0), "a")) == 1);
+        CHECK(compare(encode(1, 5, "a"), encode(1, 5, "a")) == 0);
+        CHECK(compare(encode(0, 0, "z"), encode(1, 9, "a")) == -1);
+        CHECK(compare(encode(1, 5, "a"), encode(1, 5, "ab")) == -1);
+    });
+
+    test::run("thunk agrees with lmdb", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        auto all = keys(300, 1);
+        dbi db = fill(e, "k", all);
+        auto expected = all;
+        std::sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) {
+            return compare(a, b) < 0;
+        });
+        CHECK(scan(e, {db}, key_range::all()) == expected);
+        std::reverse(expected.begin(), expected.end());
+        CHECK(scan(e, {db}, key_range::all().reversed()) == expected);
+
+        read_txn t(e.handle());
+        for (size_t i = 0; i + 1 < all.size(); ++i) {
+            CHECK(db.compare(t.handle(), val(all[i]), val(all[i + 1])) == compare(all[i], all[i + 1]));
+            CHECK(db.compare(t.handle(), val(all[i + 1]), val(all[i])) == compare(all[i + 1], all[i]));
+        }
+    });
+
+    test::run("merge order agrees with lmdb", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        auto a = keys(200, 2), b = keys(200, 3);
+        dbi first = fill(e, "a", a);
+        dbi second = fill(e, "b", b);
+        std::vector<std::string> expected = a;
+        expected.insert(expected.end(), b.begin(), b.end());
+        std::stable_sort(expected.begin(), expected.end(), [](const auto& x, const auto& y) {
+            return compare(x, y) < 0;
+        });
+        auto merged = scan(e, {first, second}, key_range::all());
+        CHECK(merged.size() == expected.size());
+        for (size_t i = 0; i + 1 < merged.size(); ++i) {
+            CHECK(compare(merged[i], merged[i + 1]) <= 0);
+        }
+        std::sort(merged.begin(), merged.end());
+        std::sort(expected.begin(), expected.end());
+        CHECK(merged == expected);
+
+        auto reversed = scan(e, {first, second}, key_range::all().reversed());
+        CHECK(reversed.size() == expected.size());
+        for (size_t i = 0; i + 1 < reversed.size(); ++i) {
+            CHECK(compare(reversed[i], reversed[i + 1]) >= 0);
+        }
+    });
+}
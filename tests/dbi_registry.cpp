@@ -0,0 +1,107 @@
+#include "test.hpp"
+#include "lmdb-wrapper/dbi_registry.hpp"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace lmdb;
+
+namespace {
+
+int by_size(const MDB_val* a, const MDB_val* b) {
+    return a->mv_size < b->mv_size? -1 : a->mv_size > b->mv_size;
+}
+
+int by_size_reversed(const MDB_val* a, const MDB_val* b) {
+    return by_size(b, a);
+}
+
+}
+
+int main() {
+    test::run("open in an existing txn", []() {
+        test::temp_dir dir;
+        {
+            auto e = test::open_env(dir.path());
+            write_txn t(e.handle());
+            t.put<std::string>(t.db().set(dbi::flags::create).open("a"), std::string("k"), std::string("v"), 0);
+            t.commit();
+        }
+        // a fresh process: the first open happens in a transaction that already began
+        auto e = test::open_env(dir.path());
+        write_txn t(e.handle());
+        dbi db = t.db().open("a");
+        CHECK(t.get<std::string>(db, std::string("k")) == "v");
+        t.put<std::string>(db, std::string("l"), std::string("w"), 0);
+        auto c = db.open_cursor<std::string, std::string>(t.handle());
+        CHECK(c.get(MDB_FIRST));
+        t.commit();
+
+        read_txn r(e.handle());
+        CHECK(r.get<std::string>(r.db().open("a"), std::string("l")) == "w");
+    });
+
+    test::run("db created after the txn began", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        read_txn before(e.handle());
+        {
+            write_txn t(e.handle());
+            t.db().set(dbi::flags::create).open("b");
+            t.commit();
+        }
+        CHECK_THROWS(before.db().open("b"));
+        read_txn after(e.handle());
+        after.db().open("b");
+    });
+
+    test::run("db created by another process", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        pid_t pid = fork();
+        if (!pid) {
+            auto other = test::open_env(dir.path());
+            write_txn t(other.handle());
+            t.put<std::string>(t.db().set(dbi::flags::create).open("x"), std::string("k"), std::string("v"), 0);
+            t.commit();
+            _exit(0);
+        }
+        int status;
+        CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && !WEXITSTATUS(status));
+
+        // never registered in this process, opened in the caller's txn
+        read_txn r(e.handle());
+        CHECK(r.get<std::string>(r.db().open("x"), std::string("k")) == "v");
+        CHECK(r.get<std::string>(r.db().open("x"), std::string("k")) == "v");
+    });
+
+    test::run("missing db", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        CHECK_THROWS(e.dbis().open("y"));
+        CHECK_THROWS(e.dbis().open("y"));
+        {
+            write_txn t(e.handle());
+            t.db().set(dbi::flags::create).open("y");
+            t.commit();
+        }
+        // the commit invalidates the cached miss
+        e.dbis().open("y");
+    });
+
+    test::run("incompatible reopen", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        {
+            write_txn t(e.handle());
+            t.db().set(dbi::flags::create).set(dbi::flags::dup_sort).open("c");
+            t.commit();
+        }
+        read_txn t(e.handle());
+        t.db().open("c");
+        t.db().set(dbi::flags::dup_sort).open("c");
+        CHECK_THROWS(t.db().set(dbi::flags::integer_key).open("c"));
+        t.db().set_compare(&by_size).open("c");
+        CHECK_THROWS(t.db().set_compare(&by_size_reversed).open("c"));
+    });
+}
@@ -0,0 +1,94 @@
+#include "test.hpp"
+
+using namespace lmdb;
+using namespace std::chrono_literals;
+
+namespace {
+
+// only the commit trigger or an explicit flush syncs within a test
+env open_synced(const std::string& path, size_t commits) {
+    durability_policy policy;
+    policy.interval = std::chrono::hours(1);
+    policy.commits = commits;
+    return env::factory().set_max_dbs(4).set_map_size(size_t(64) << 20).set_durability(policy).open(path, 0644);
+}
+
+uint64_t put(env& e, const std::string& key) {
+    write_txn t(e.handle());
+    dbi db = t.db().set(dbi::flags::create).open("d");
+    t.put<std::string>(db, key, key, 0);
+    uint64_t id = t.id();
+    t.commit();
+    return id;
+}
+
+bool ready(const std::future<void>& f, std::chrono::milliseconds timeout) {
+    return f.wait_for(timeout) == std::future_status::ready;
+}
+
+}
+
+int main() {
+    test::run("commit trigger", []() {
+        test::temp_dir dir;
+        auto e = open_synced(dir.path(), 3);
+        put(e, "a");
+        uint64_t id = put(e, "b");
+        auto f = e.durable(id);
+        CHECK(!ready(f, 200ms));
+        put(e, "c");
+        CHECK(ready(f, 5s));
+        f.get();
+        CHECK(e.flush().wait_for(5s) == std::future_status::ready);
+        CHECK(e.durable(id).wait_for(0s) == std::future_status::ready);
+    });
+
+    test::run("nested commits are not counted", []() {
+        test::temp_dir dir;
+        auto e = open_synced(dir.path(), 2);
+        uint64_t id;
+        {
+            write_txn t(e.handle());
+            dbi db = t.db().set(dbi::flags::create).open("d");
+            for (int i = 0; i < 3; ++i) {
+                auto nested = t.nested_write();
+                nested.put<std::string>(db, std::to_string(i), std::string("v"), 0);
+                nested.commit();
+            }
+            id = t.id();
+            t.commit();
+        }
+        auto f = e.durable(id);
+        CHECK(!ready(f, 200ms));
+        put(e, "x");
+        CHECK(ready(f, 5s));
+    });
+
+    test::run("flush", []() {
+        test::temp_dir dir;
+        auto e = open_synced(dir.path(), 0);
+        uint64_t id = put(e, "a");
+        auto f = e.durable(id);
+        CHECK(!ready(f, 200ms));
+        e.flush().get();
+        CHECK(ready(f, 0ms));
+    });
+
+    test::run("unassigned ids", []() {
+        test::temp_dir dir;
+        auto e = open_synced(dir.path(), 1);
+        uint64_t id = put(e, "a");
+        CHECK_THROWS(e.durable(id + 2));
+        // the id of the next transaction, waited on before it commits
+        auto f = e.durable(id + 1);
+        CHECK(put(e, "b") == id + 1);
+        CHECK(ready(f, 5s));
+    });
+
+    test::run("no policy", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        CHECK_THROWS(e.durable(1));
+        CHECK_THROWS(e.flush());
+    });
+}
@@ -0,0 +1,136 @@
+#include "test.hpp"
+#include "lmdb-wrapper/dbi_registry.hpp"
+#include "lmdb-wrapper/write_batch.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace lmdb;
+
+namespace {
+
+dbi create(env& e, const std::string& name) {
+    write_txn t(e.handle());
+    dbi db = t.db().set(dbi::flags::create).open(name);
+    t.put<std::string>(db, std::string("a"), std::string("1"), 0);
+    t.commit();
+    return db;
+}
+
+key_filter& enable(env& e, const std::string& name) {
+    key_filter::options opts;
+    opts.persist = false;
+    auto& f = e.dbis().enable_filter(name, opts);
+    while (!f.ready()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return f;
+}
+
+}
+
+int main() {
+    test::run("write_batch puts", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e, "f");
+        enable(e, "f");
+        {
+            read_txn r(e.handle());
+            CHECK(r.get<std::string>(db, std::string("a")) == "1");
+            CHECK(r.get<std::string>(db, std::string("b"), std::string("none")) == "none");
+        }
+        write_batch batch(e);
+        batch.put(db, std::string("b"), std::string("2"));
+        batch.commit();
+
+        read_txn r(e.handle());
+        CHECK(r.get<std::string>(db, std::string("b")) == "2");
+    });
+
+    test::run("commits outside write_txn", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e, "f");
+        auto& f = enable(e, "f");
+        size_t builds = f.builds();
+
+        MDB_txn *txn;
+        CHECK(!mdb_txn_begin(e.handle(), nullptr, 0, &txn));
+        MDB_val key{1, const_cast<char*>("c")}, data{1, const_cast<char*>("3")};
+        CHECK(!mdb_put(txn, db.handle(), &key, &data, 0));
+        CHECK(!mdb_txn_commit(txn));
+
+        read_txn r(e.handle());
+        CHECK(r.get<std::string>(db, std::string("c")) == "3");
+        CHECK(f.builds() > builds);
+    });
+
+    test::run("reads during local commits", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e, "f");
+        auto& f = enable(e, "f");
+        size_t builds = f.builds();
+
+        std::atomic<bool> done{false};
+        std::thread reader([&]() {
+            while (!done) {
+                read_txn r(e.handle());
+                r.get<std::string>(db, std::string("absent"), std::string());
+            }
+        });
+        for (int i = 0; i < 200; ++i) {
+            write_txn t(e.handle());
+            t.put<std::string>(db, "k" + std::to_string(i), std::string("v"), 0);
+            t.commit();
+        }
+        // created by the registry in a write transaction of its own
+        e.dbis().open("g", MDB_CREATE);
+        {
+            write_txn t(e.handle());
+            t.put<std::string>(db, std::string("last"), std::string("v"), 0);
+            t.commit();
+        }
+        done = true;
+        reader.join();
+
+        read_txn r(e.handle());
+        CHECK(r.get<std::string>(db, std::string("k199")) == "v");
+        CHECK(r.get<std::string>(db, std::string("absent"), std::string("none")) == "none");
+        CHECK(f.builds() == builds);
+    });
+
+    test::run("overwrites are not new entries", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e, "f");
+        auto& f = enable(e, "f");
+        size_t entries = f.entries();
+        for (int i = 0; i < 100; ++i) {
+            write_txn t(e.handle());
+            t.put<std::string>(db, std::string("a"), std::to_string(i), 0);
+            t.commit();
+        }
+        CHECK(f.entries() == entries);
+        write_txn t(e.handle());
+        t.put<std::string>(db, std::string("new"), std::string("v"), 0);
+        t.commit();
+        CHECK(f.entries() <= entries + 1);
+    });
+
+    test::run("enable while a writer opens a db", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        create(e, "f");
+        write_txn t(e.handle());
+        std::thread enabler([&]() {
+            enable(e, "f");
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        t.db().set(dbi::flags::create).open("g");
+        t.commit();
+        enabler.join();
+    });
+}
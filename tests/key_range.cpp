@@ -0,0 +1,99 @@
+#include "test.hpp"
+#include "lmdb-wrapper/db_iterator.hpp"
+
+using namespace lmdb;
+
+namespace {
+
+dbi fill(env& e, const std::string& name, const std::vector<std::string>& keys) {
+    write_txn t(e.handle());
+    dbi db = t.db().set(dbi::flags::create).open(name);
+    for (const auto& key : keys) {
+        t.put<std::string>(db, key, key, 0);
+    }
+    t.commit();
+    return db;
+}
+
+std::vector<std::string> scan(env& e, const std::vector<dbi>& dbis, const key_range& r, size_t limit = SIZE_MAX) {
+    read_txn t(e.handle());
+    std::vector<std::string> result;
+    for (const auto& [key, value] : range(db_iterator<std::string, std::string>(t, dbis, r))) {
+        CHECK(key == value);
+        if (result.size() == limit) {
+            break;
+        }
+        result.push_back(key);
+    }
+    return result;
+}
+
+// big endian, so that the keys of a user sort by time
+std::string event(const std::string& user, uint64_t time) {
+    std::string key = "user:" + user + ":";
+    for (int i = 7; i >= 0; --i) {
+        key.push_back(static_cast<char>(time >> (8 * i)));
+    }
+    return key;
+}
+
+}
+
+int main() {
+    test::run("reverse prefix with carry", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = fill(e, "r", {"a\xfe", "a\xff", "a\xff\x01", "a\xff\xff", "b"});
+        auto keys = scan(e, {db}, key_range::prefix(std::string("a\xff")).reversed());
+        CHECK((keys == std::vector<std::string>{"a\xff\xff", "a\xff\x01", "a\xff"}));
+        keys = scan(e, {db}, key_range::prefix(std::string("a\xff")));
+        CHECK((keys == std::vector<std::string>{"a\xff", "a\xff\x01", "a\xff\xff"}));
+    });
+
+    test::run("reverse prefix of 0xff bytes", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = fill(e, "r", {"\xfe", "\xff", "\xff\xff", "\xff\xff\x01"});
+        auto keys = scan(e, {db}, key_range::prefix(std::string("\xff\xff")).reversed());
+        CHECK((keys == std::vector<std::string>{"\xff\xff\x01", "\xff\xff"}));
+        keys = scan(e, {db}, key_range::prefix(std::string("\xff")).reversed());
+        CHECK((keys == std::vector<std::string>{"\xff\xff\x01", "\xff\xff", "\xff"}));
+    });
+
+    test::run("reverse bounds", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = fill(e, "r", {"a", "b", "c", "d"});
+        CHECK((scan(e, {db}, key_range::between(std::string("b"), std::string("z")).reversed()) == std::vector<std::string>{"d", "c", "b"}));
+        CHECK((scan(e, {db}, key_range::between(std::string("b"), std::string("d")).reversed()) == std::vector<std::string>{"c", "b"}));
+        CHECK((scan(e, {db}, key_range::between(std::string("0"), std::string("a")).reversed()).empty()));
+        CHECK((scan(e, {db}, key_range::until(std::string("c")).reversed()) == std::vector<std::string>{"b", "a"}));
+        CHECK((scan(e, {db}, key_range::from(std::string("c")).reversed()) == std::vector<std::string>{"d", "c"}));
+        CHECK((scan(e, {db}, key_range::all().reversed()) == std::vector<std::string>{"d", "c", "b", "a"}));
+    });
+
+    test::run("reverse merge", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi odd = fill(e, "odd", {"1", "3", "5"});
+        dbi even = fill(e, "even", {"2", "4", "6"});
+        CHECK((scan(e, {odd, even}, key_range::all().reversed()) == std::vector<std::string>{"6", "5", "4", "3", "2", "1"}));
+        CHECK((scan(e, {odd, even}, key_range::between(std::string("2"), std::string("5")).reversed()) == std::vector<std::string>{"4", "3", "2"}));
+        CHECK((scan(e, {odd, even}, key_range::all()) == std::vector<std::string>{"1", "2", "3", "4", "5", "6"}));
+    });
+
+    test::run("latest events of a user", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        std::vector<std::string> keys;
+        for (uint64_t time : std::vector<uint64_t>{1, 255, 256, 70000, uint64_t(-1)}) {
+            keys.push_back(event("41", time));
+            keys.push_back(event("42", time));
+            keys.push_back(event("43", time));
+        }
+        dbi db = fill(e, "events", keys);
+        auto latest = scan(e, {db}, key_range::prefix(std::string("user:42:")).reversed(), 3);
+        CHECK((latest == std::vector<std::string>{event("42", uint64_t(-1)), event("42", 70000), event("42", 256)}));
+    });
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "test.hpp"
+#include "lmdb-wrapper/posting_list.hpp"
+
+#include <vector>
+
+using namespace lmdb;
+
+int main() {
+    test::run("single value keys", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db;
+        {
+            write_txn t(e.handle());
+            db = t.db().set(dbi::flags::create).set(dbi::flags::dup_sort).set(dbi::flags::dup_fixed).set(dbi::flags::integer_dup).open("p");
+            t.put<unsigned int>(db, std::string("one"), 700u, 0);
+            for (unsigned int i = 0; i < 2000; ++i) {
+                t.put<unsigned int>(db, std::string("many"), i, 0);
+            }
+            t.commit();
+        }
+        read_txn t(e.handle());
+        posting_list<unsigned int> one(t.handle(), db, std::string("one"));
+        CHECK(one.valid());
+        CHECK(one.value() == 700);
+        one.next();
+        CHECK(!one.valid());
+
+        std::vector<unsigned int> found;
+        posting_iterator<unsigned int> it(t, set_op::intersect, db, std::vector<std::string>{"many", "one"});
+        for (; it != posting_iterator<unsigned int>(); ++it) {
+            found.push_back(*it);
+        }
+        CHECK(found == std::vector<unsigned int>{700});
+    });
+}
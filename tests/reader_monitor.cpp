@@ -0,0 +1,125 @@
+#include "test.hpp"
+
+#include <mutex>
+#include <thread>
+
+using namespace lmdb;
+using namespace std::chrono_literals;
+
+namespace {
+
+env open_monitored(const std::string& path, const reader_monitor_options& opts, reader_monitor::callback on_stale = nullptr) {
+    return env::factory().set_max_dbs(4).set_map_size(size_t(64) << 20).set_reader_monitor(opts, on_stale).open(path, 0644);
+}
+
+template <class F>
+bool eventually(F f) {
+    for (int i = 0; i < 500; ++i) {
+        if (f()) {
+            return true;
+        }
+        std::this_thread::sleep_for(10ms);
+    }
+    return false;
+}
+
+// commits from another thread, this one may hold a read transaction
+void overwrite(env& e, int commits) {
+    std::thread([&]() {
+        for (int i = 0; i < commits; ++i) {
+            write_txn t(e.handle());
+            dbi db = t.db().set(dbi::flags::create).open("m");
+            for (int k = 0; k < 100; ++k) {
+                t.put<std::string>(db, std::to_string(k), std::string(100, 'a' + i % 26), 0);
+            }
+            t.commit();
+        }
+    }).join();
+}
+
+}
+
+int main() {
+    test::run("stale readers", []() {
+        test::temp_dir dir;
+        reader_monitor_options opts;
+        opts.interval = 10ms;
+        opts.max_age = std::chrono::hours(1);
+        opts.max_lag = 3;
+        opts.track_origins = true;
+        std::mutex mutex;
+        std::vector<reader_info> reported;
+        auto e = open_monitored(dir.path(), opts, [&](const reader_info& r) {
+            std::lock_guard<std::mutex> lock(mutex);
+            reported.push_back(r);
+        });
+        overwrite(e, 1);
+        reader_monitor::label_thread("main");
+        read_txn t(e.handle());
+        overwrite(e, 5);
+        CHECK(eventually([&]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return !reported.empty();
+        }));
+        std::this_thread::sleep_for(50ms);
+        std::lock_guard<std::mutex> lock(mutex);
+        CHECK(reported.size() == 1);
+        CHECK(reported[0].txnid == t.id() && reported[0].lag > 3);
+        CHECK(reported[0].tracked && std::string(reported[0].label) == "main");
+    });
+
+    test::run("readers", []() {
+        test::temp_dir dir;
+        reader_monitor_options opts;
+        opts.interval = std::chrono::hours(1);
+        auto e = open_monitored(dir.path(), opts);
+        overwrite(e, 1);
+        // idle slots kept by threads that read before are listed without a snapshot
+        auto active = [&]() {
+            std::vector<reader_info> result;
+            for (const auto& r : e.monitor().readers()) {
+                if (r.txnid) {
+                    result.push_back(r);
+                }
+            }
+            return result;
+        };
+        CHECK(active().empty());
+        read_txn t(e.handle());
+        auto readers = active();
+        CHECK(readers.size() == 1 && readers[0].txnid == t.id() && readers[0].lag == 0);
+        overwrite(e, 2);
+        CHECK(active()[0].lag == 2);
+    });
+
+    test::run("free pages counted sparingly", []() {
+        test::temp_dir dir;
+        reader_monitor_options opts;
+        opts.interval = 10ms;
+        opts.freelist_interval = std::chrono::hours(1);
+        auto e = open_monitored(dir.path(), opts);
+        CHECK(eventually([&]() {
+            return e.monitor().space().used_pages != 0;
+        }));
+        uint64_t first = e.monitor().space().free_txnid;
+        overwrite(e, 10);
+        CHECK(eventually([&]() {
+            auto s = e.monitor().space();
+            return s.last_txnid >= first + 10;
+        }));
+        CHECK(e.monitor().space().free_txnid == first);
+    });
+
+    test::run("free pages recounted", []() {
+        test::temp_dir dir;
+        reader_monitor_options opts;
+        opts.interval = 10ms;
+        opts.freelist_interval = 0ms;
+        auto e = open_monitored(dir.path(), opts);
+        overwrite(e, 10);
+        CHECK(eventually([&]() {
+            auto s = e.monitor().space();
+            return s.free_txnid == s.last_txnid && s.last_txnid >= 10;
+        }));
+    });
+}
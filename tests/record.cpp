@@ -0,0 +1,98 @@
+#include "test.hpp"
+#include "lmdb-wrapper/record.hpp"
+
+using namespace lmdb;
+
+namespace {
+
+using id = field<0, uint64_t>;
+using name = field<1, std::string_view>;
+using score = field<2, double>;
+using tag = field<4, std::string_view>;
+
+using v1 = schema<1, id, name>;
+using v2 = schema<2, id, name, score, tag>;
+
+// readers that got the type of a field wrong
+using narrow_id = field<0, uint32_t>;
+using name_as_number = field<1, uint64_t>;
+using id_as_text = field<0, std::string_view>;
+using mistyped = schema<1, narrow_id, name_as_number>;
+using mistyped_text = schema<1, id_as_text>;
+
+MDB_val view_of(const std::string& s) {
+    return MDB_val{s.size(), const_cast<char*>(s.data())};
+}
+
+}
+
+int main() {
+    test::run("fields", []() {
+        std::string encoded = record_builder<v2>().set<id>(7).set<name>("alice").set<tag>("").encode();
+        record_view<v2> r(view_of(encoded));
+        CHECK(r.version() == 2);
+        CHECK(r.has<id>() && r.get<id>() == 7);
+        CHECK(r.get<name>() == "alice");
+        CHECK(r.has<tag>() && r.get<tag>().empty());
+        CHECK(!r.has<score>());
+        CHECK_THROWS(r.get<score>());
+        CHECK(r.get<score>(1.5) == 1.5);
+    });
+
+    test::run("reset", []() {
+        std::string encoded = record_builder<v2>().set<id>(1).set<score>(2.0).reset<score>().encode();
+        record_view<v2> r(view_of(encoded));
+        CHECK(r.has<id>() && !r.has<score>());
+    });
+
+    test::run("versions", []() {
+        // older records lack the new fields, newer ones carry fields the old schema ignores
+        std::string old_record = record_builder<v1>().set<id>(3).set<name>("bob").encode();
+        record_view<v2> upgraded(view_of(old_record));
+        CHECK(upgraded.version() == 1);
+        CHECK(upgraded.get<name>() == "bob");
+        CHECK(!upgraded.has<score>() && !upgraded.has<tag>());
+
+        std::string new_record = record_builder<v2>().set<id>(4).set<score>(0.5).set<tag>("x").encode();
+        record_view<v1> downgraded(view_of(new_record));
+        CHECK(downgraded.get<id>() == 4 && !downgraded.has<name>());
+
+        std::string copied = record_builder<v2>(upgraded).set<score>(9.0).encode();
+        record_view<v2> r(view_of(copied));
+        CHECK(r.version() == 2 && r.get<id>() == 3 && r.get<name>() == "bob" && r.get<score>() == 9.0);
+    });
+
+    test::run("corrupted", []() {
+        std::string encoded = record_builder<v2>().set<id>(5).set<name>("carol").encode();
+        record_view<v2> empty;
+        CHECK(empty.version() == 0 && !empty.has<id>());
+        CHECK_THROWS(record_view<v2>(MDB_val{3, encoded.data()}));
+        record_view<v2> truncated(MDB_val{encoded.size() - 2, encoded.data()});
+        CHECK_THROWS(truncated.get<name>());
+    });
+
+    test::run("type mismatch", []() {
+        std::string encoded = record_builder<v1>().set<id>(6).set<name>("erin").encode();
+        record_view<mistyped> r(view_of(encoded));
+        CHECK(r.has<narrow_id>() && r.has<name_as_number>());
+        CHECK_THROWS(r.get<narrow_id>());
+        CHECK_THROWS(r.get<name_as_number>());
+        CHECK_THROWS(record_view<mistyped_text>(view_of(encoded)).get<id_as_text>());
+        CHECK(record_view<v1>(view_of(encoded)).get<id>() == 6);
+    });
+
+    test::run("stored", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        {
+            write_txn t(e.handle());
+            dbi db = t.db().set(dbi::flags::create).open("records");
+            t.put<record_builder<v2>>(db, std::string("k"), record_builder<v2>().set<id>(8).set<name>("dave"), 0);
+            t.commit();
+        }
+        read_txn t(e.handle());
+        auto r = t.get<record_view<v2>>(t.db().open("records"), std::string("k"));
+        CHECK(r.get<id>() == 8 && r.get<name>() == "dave" && !r.has<score>());
+    });
+    return 0;
+}
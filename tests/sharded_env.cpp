@@ -0,0 +1,138 @@
+#include "test.hpp"
+#include "lmdb-wrapper/sharded_env.hpp"
+
+using namespace lmdb;
+
+namespace {
+
+std::string make_dir(const test::temp_dir& dir, const std::string& name) {
+    auto path = std::filesystem::path(dir.path()) / name;
+    std::filesystem::create_directories(path);
+    return path.string();
+}
+
+env::factory env_factory() {
+    return env::factory().set_max_dbs(4).set_map_size(size_t(64) << 20);
+}
+
+std::string numbered(int i) {
+    std::string result = std::to_string(i);
+    return std::string(3 - result.size(), '0') + result;
+}
+
+sharded_env open_hashed(const test::temp_dir& dir, size_t shards) {
+    sharded_env::factory f(env_factory());
+    for (size_t i = 0; i < shards; ++i) {
+        f.add_shard(make_dir(dir, "s" + std::to_string(i)));
+    }
+    return f.add_db("x").open(0644);
+}
+
+}
+
+int main() {
+    test::run("routing", []() {
+        test::temp_dir dir;
+        auto s = open_hashed(dir, 2);
+        hash_partitioner partitioner(2);
+        for (int i = 0; i < 100; ++i) {
+            s.put<std::string>("x", numbered(i), std::string("v")).get();
+        }
+        for (int i = 0; i < 100; ++i) {
+            std::string key = numbered(i);
+            size_t owner = partitioner.shard(value::pack(key));
+            for (size_t shard = 0; shard < 2; ++shard) {
+                read_txn t(s.shard_env(shard).handle());
+                bool found = t.get<std::string>(t.db().open("x"), key, std::string()) == "v";
+                CHECK(found == (shard == owner));
+            }
+            CHECK(s.get<std::string>("x", key) == "v");
+        }
+    });
+
+    test::run("merged scan", []() {
+        test::temp_dir dir;
+        auto s = open_hashed(dir, 3);
+        std::vector<std::future<void>> done;
+        for (int i = 99; i >= 0; --i) {
+            done.push_back(s.put<std::string>("x", numbered(i), std::to_string(i)));
+        }
+        for (auto& f : done) {
+            f.get();
+        }
+        int expected = 0;
+        for (const auto& [key, value] : range(s.scan<std::string, std::string>("x"))) {
+            CHECK(key == numbered(expected) && value == std::to_string(expected));
+            ++expected;
+        }
+        CHECK(expected == 100);
+
+        expected = 59;
+        for (const auto& [key, value] : range(s.scan<std::string, std::string>("x", key_range::prefix(std::string("05")).reversed()))) {
+            CHECK(key == numbered(expected));
+            --expected;
+        }
+        CHECK(expected == 49);
+    });
+
+    test::run("batched commits", []() {
+        test::temp_dir dir;
+        auto s = open_hashed(dir, 1);
+        env e = s.shard_env(0);
+        MDB_envinfo before, after;
+        CHECK(!mdb_env_info(e.handle(), &before));
+
+        // the writer waits for the write lock while the puts queue up
+        std::vector<std::future<void>> done;
+        {
+            write_txn blocker(e.handle());
+            for (int i = 0; i < 100; ++i) {
+                done.push_back(s.put<std::string>("x", numbered(i), std::string("v")));
+            }
+            blocker.abort();
+        }
+        for (auto& f : done) {
+            f.get();
+        }
+        CHECK(!mdb_env_info(e.handle(), &after));
+        CHECK(after.me_last_txnid - before.me_last_txnid <= 2);
+        CHECK(s.get<std::string>("x", numbered(99)) == "v");
+    });
+
+    test::run("split failure", []() {
+        test::temp_dir dir;
+        // the new shard already holds a key sorting after the moved ones,
+        // so moving them with MDB_APPEND fails
+        std::string taken = make_dir(dir, "taken");
+        {
+            auto e = env_factory().open(taken, 0644);
+            write_txn t(e.handle());
+            t.put<std::string>(t.db().set(dbi::flags::create).open("x"), std::string("zz"), std::string("old"), 0);
+            t.commit();
+        }
+
+        auto s = sharded_env::factory(env_factory()).add_shard(make_dir(dir, "first")).add_db("x")
+            .set_partitioner(std::make_shared<range_partitioner>(std::vector<std::string>{})).open(0644);
+        for (char c = 'a'; c <= 'z'; ++c) {
+            s.put<std::string>("x", std::string(1, c), std::string("v")).get();
+        }
+
+        CHECK_THROWS(s.split(0, std::string("m"), taken));
+        CHECK(s.size() == 1);
+        CHECK(s.get<std::string>("x", std::string("q")) == "v");
+
+        s.split(0, std::string("m"), make_dir(dir, "second"));
+        CHECK(s.size() == 2);
+        CHECK(s.get<std::string>("x", std::string("a")) == "v");
+        CHECK(s.get<std::string>("x", std::string("q")) == "v");
+        read_txn first(s.shard_env(0).handle());
+        CHECK(first.get<std::string>(first.db().open("x"), std::string("q"), std::string("none")) == "none");
+    });
+
+    test::run("split of integer keys", []() {
+        test::temp_dir dir;
+        auto s = sharded_env::factory(env_factory()).add_shard(make_dir(dir, "first")).add_db("x", MDB_CREATE | MDB_INTEGERKEY)
+            .set_partitioner(std::make_shared<range_partitioner>(std::vector<std::string>{})).open(0644);
+        CHECK_THROWS(s.split(0, size_t(10), make_dir(dir, "second")));
+    });
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "lmdb-wrapper/env.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <random>
+#include <string>
+
+/**
+    Minimal checks shared by the test executables, a failed check ends the
+    process with a non-zero status.
+*/
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            std::exit(1); \
+        } \
+    } while (false)
+
+#define CHECK_THROWS(expr) \
+    do { \
+        bool thrown = false; \
+        try { \
+            expr; \
+        } catch (const std::exception&) { \
+            thrown = true; \
+        } \
+        if (!thrown) { \
+            std::fprintf(stderr, "%s:%d: no exception: %s\n", __FILE__, __LINE__, #expr); \
+            std::exit(1); \
+        } \
+    } while (false)
+
+namespace lmdb::test {
+
+/**
+    Empty directory removed with its content at the end of the scope.
+*/
+class temp_dir {
+public:
+    temp_dir() {
+        std::random_device random;
+        path_ = std::filesystem::temp_directory_path() / ("lmdb-wrapper-test-" + std::to_string(random()));
+        std::filesystem::create_directories(path_);
+    }
+
+    ~temp_dir() {
+        std::error_code ignored;
+        std::filesystem::remove_all(path_, ignored);
+    }
+
+    temp_dir(const temp_dir&) = delete;
+    temp_dir& operator=(const temp_dir&) = delete;
+
+    std::string path() const {
+        return path_.string();
+    }
+
+private:
+    std::filesystem::path path_;
+};
+
+inline env open_env(const std::string& path, unsigned int dbs = 8) {
+    return env::factory().set_max_dbs(dbs).set_map_size(size_t(64) << 20).open(path, 0644);
+}
+
+template <class F>
+void run(const char* name, F f) {
+    try {
+        f();
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s: %s\n", name, e.what());
+        std::exit(1);
+    }
+    std::printf("%s ok\n", name);
+}
+
+}
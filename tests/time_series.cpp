@@ -0,0 +1,47 @@
+#include "test.hpp"
+#include "lmdb-wrapper/time_series.hpp"
+
+using namespace lmdb;
+
+int main() {
+    test::run("abort", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db;
+        {
+            write_txn t(e.handle());
+            db = t.db().set(dbi::flags::create).open("ts");
+            t.commit();
+        }
+        time_series ts(db, 4);
+        {
+            write_txn t(e.handle());
+            for (int64_t i = 0; i < 6; ++i) {
+                ts.append(t, 1, i, double(i));
+            }
+            t.abort();
+        }
+        {
+            read_txn t(e.handle());
+            CHECK(ts.range(t, 1, 0, 100).time.empty());
+        }
+        {
+            write_txn t(e.handle());
+            for (int64_t i = 0; i < 6; ++i) {
+                ts.append(t, 1, i, double(i));
+            }
+            // dropped without commit
+        }
+        {
+            write_txn t(e.handle());
+            for (int64_t i = 10; i < 16; ++i) {
+                ts.append(t, 1, i, double(i));
+            }
+            t.commit();
+        }
+        read_txn t(e.handle());
+        auto s = ts.range(t, 1, 0, 100);
+        CHECK(s.time.size() == 6);
+        CHECK(s.time.front() == 10 && s.value.back() == 15.0);
+    });
+}
@@ -0,0 +1,133 @@
+#include "test.hpp"
+#include "lmdb-wrapper/trace.hpp"
+
+#include <cerrno>
+
+using namespace lmdb;
+
+namespace {
+
+using op = trace_recorder::op;
+
+constexpr size_t op_count = static_cast<size_t>(op::cursor_get) + 1;
+
+std::vector<trace_record> read_all(const std::string& path) {
+    trace_reader reader(path);
+    std::vector<trace_record> result;
+    while (auto rec = reader.next()) {
+        result.push_back(std::move(*rec));
+    }
+    return result;
+}
+
+// one record of every kind, with fields telling them apart
+void record_all(const std::string& path, trace_recorder::key_mode keys) {
+    trace_recorder::options opts;
+    opts.keys = keys;
+    // small enough to flush in the middle of the trace
+    opts.buffer_size = 32;
+    trace_recorder::start(path, opts);
+    auto recorder = trace_recorder::acquire();
+    CHECK(recorder);
+    for (size_t i = 0; i < op_count; ++i) {
+        std::string key = "key" + std::to_string(i);
+        MDB_val k{key.size(), key.data()};
+        int err = i % 3 == 0? 0 : i % 3 == 1? MDB_NOTFOUND : EINVAL;
+        unsigned int flags = static_cast<op>(i) == op::txn_begin? MDB_RDONLY | trace_recorder::nested : static_cast<unsigned int>(i * 3);
+        recorder->record(static_cast<op>(i), err, trace_recorder::now(), static_cast<MDB_dbi>(i + 1), flags, i % 2? nullptr : &k, i * 100);
+    }
+    trace_recorder::release();
+    trace_recorder::stop();
+}
+
+}
+
+int main() {
+    test::run("round trip", []() {
+        test::temp_dir dir;
+        std::string path = dir.path() + "/trace";
+        record_all(path, trace_recorder::key_mode::full);
+        auto records = read_all(path);
+        CHECK(records.size() == op_count);
+        for (size_t i = 0; i < records.size(); ++i) {
+            const auto& r = records[i];
+            CHECK(r.kind == static_cast<op>(i));
+            CHECK(r.result == (i % 3 == 0? trace_recorder::status::ok : i % 3 == 1? trace_recorder::status::not_found : trace_recorder::status::error));
+            CHECK(r.dbi == i + 1);
+            CHECK(r.value_size == i * 100);
+            CHECK(r.thread == records[0].thread);
+            if (i % 2) {
+                CHECK(r.keys == trace_recorder::key_mode::none && r.key.empty());
+            } else {
+                CHECK(r.keys == trace_recorder::key_mode::full && r.key == "key" + std::to_string(i));
+            }
+            if (i) {
+                CHECK(r.start >= records[i - 1].start);
+            }
+        }
+        CHECK(records[static_cast<size_t>(op::txn_begin)].flags == (MDB_RDONLY | trace_recorder::nested));
+        CHECK(records[static_cast<size_t>(op::put)].flags == static_cast<size_t>(op::put) * 3);
+    });
+
+    test::run("hashed keys", []() {
+        test::temp_dir dir;
+        std::string first = dir.path() + "/first", second = dir.path() + "/second";
+        record_all(first, trace_recorder::key_mode::hash);
+        record_all(second, trace_recorder::key_mode::hash);
+        auto a = read_all(first), b = read_all(second);
+        CHECK(a.size() == op_count && b.size() == op_count);
+        for (size_t i = 0; i < op_count; i += 2) {
+            // database names are kept in full for replay
+            if (a[i].kind == op::dbi_open) {
+                CHECK(a[i].keys == trace_recorder::key_mode::full && a[i].key == "key0");
+                continue;
+            }
+            CHECK(a[i].keys == trace_recorder::key_mode::hash && a[i].key.empty());
+            CHECK(a[i].key_hash == b[i].key_hash);
+            CHECK(i < 2 || a[i].key_hash != a[i - 2].key_hash);
+        }
+    });
+
+    test::run("wrapper operations", []() {
+        test::temp_dir dir;
+        std::string path = dir.path() + "/trace";
+        auto e = test::open_env(dir.path());
+        trace_recorder::start(path);
+        {
+            write_txn t(e.handle());
+            dbi db = t.db().set(dbi::flags::create).open("t");
+            t.put<std::string>(db, std::string("a"), std::string("value"), 0);
+            {
+                auto nested = t.nested_write();
+                nested.del(db, std::string("a"));
+                nested.abort();
+            }
+            t.commit();
+        }
+        {
+            read_txn t(e.handle());
+            dbi db = t.db().open("t");
+            CHECK(t.get<std::string>(db, std::string("a")) == "value");
+            {
+                auto c = db.open_cursor<std::string, std::string>(t.handle());
+            }
+            t.reset();
+            t.renew();
+        }
+        trace_recorder::stop();
+
+        std::vector<size_t> counts(op_count);
+        for (const auto& r : read_all(path)) {
+            ++counts[static_cast<size_t>(r.kind)];
+            if (r.kind == op::put) {
+                CHECK(r.key == "a" && r.value_size == 5);
+            }
+            if (r.kind == op::dbi_open && r.keys != trace_recorder::key_mode::none) {
+                CHECK(r.key == "t");
+            }
+        }
+        for (size_t i = 0; i < op_count; ++i) {
+            CHECK(counts[i] > 0);
+        }
+    });
+}
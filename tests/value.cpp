@@ -0,0 +1,123 @@
+#include "test.hpp"
+
+using namespace lmdb;
+
+namespace {
+
+/**
+    Counts what is allocated from it, the memory comes from new/delete.
+*/
+class counting_resource : public std::pmr::memory_resource {
+public:
+    size_t allocations = 0;
+    size_t bytes = 0;
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        ++allocations;
+        bytes += size;
+        return std::pmr::new_delete_resource()->allocate(size, alignment);
+    }
+
+    void do_deallocate(void* p, size_t size, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// longer than any small string buffer, so that every element allocates
+const std::string long_entry(64, 'x');
+
+template <class List>
+List round_trip(const List& list, std::pmr::memory_resource* resource) {
+    object<List> packed(list);
+    object<List> unpacked(*packed.data());
+    return unpacked.value(resource);
+}
+
+}
+
+int main() {
+    test::run("string lists", []() {
+        std::vector<std::string> list = {"a", "", long_entry, "b c"};
+        CHECK(round_trip(list, std::pmr::get_default_resource()) == list);
+        CHECK(round_trip(std::vector<std::string>(), std::pmr::get_default_resource()).empty());
+
+        object<std::vector<std::string>> packed(list);
+        CHECK(packed.data()->mv_size == 2 + 1 + long_entry.size() + 1 + 4);
+        object<std::vector<std::string_view>> views(*packed.data());
+        auto decoded = views.value();
+        CHECK(decoded.size() == 4 && decoded[2] == long_entry);
+        // the views point into the packed data
+        CHECK(decoded[0].data() == static_cast<const char*>(packed.data()->mv_data));
+    });
+
+    test::run("pmr decoding", []() {
+        counting_resource resource;
+        std::pmr::vector<std::pmr::string> list;
+        list.emplace_back("a");
+        list.emplace_back(long_entry);
+        list.emplace_back("");
+        auto decoded = round_trip(list, &resource);
+        CHECK(decoded == list);
+        CHECK(decoded.get_allocator().resource() == &resource);
+        for (const auto& s : decoded) {
+            CHECK(s.get_allocator().resource() == &resource);
+        }
+        // the vector and the long entry
+        CHECK(resource.allocations >= 2 && resource.bytes >= long_entry.size());
+
+        size_t before = resource.allocations;
+        std::pmr::string s(long_entry);
+        object<std::pmr::string> packed(s);
+        auto value = object<std::pmr::string>(*packed.data()).value(&resource);
+        CHECK(value == s && value.get_allocator().resource() == &resource);
+        CHECK(resource.allocations == before + 1);
+    });
+
+    test::run("cursor resource", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        std::pmr::vector<std::pmr::string> list;
+        list.emplace_back(long_entry);
+        list.emplace_back("b");
+        dbi db;
+        {
+            write_txn t(e.handle());
+            db = t.db().set(dbi::flags::create).open("lists");
+            t.put<std::pmr::vector<std::pmr::string>>(db, std::string("pmr"), list, 0);
+            t.put<std::vector<std::string>>(db, std::string("std"), std::vector<std::string>{"c", long_entry}, 0);
+            t.commit();
+        }
+
+        read_txn t(e.handle());
+        CHECK((t.get<std::vector<std::string>>(db, std::string("std")) == std::vector<std::string>{"c", long_entry}));
+
+        counting_resource resource;
+        auto c = db.open_cursor<std::string, std::pmr::vector<std::pmr::string>>(t.handle(), &resource);
+        CHECK(c.resource() == &resource);
+        auto first = c.get(MDB_FIRST);
+        CHECK(first && first->first == "pmr" && first->second == list);
+        CHECK(first->second.get_allocator().resource() == &resource);
+        CHECK(first->second[0].get_allocator().resource() == &resource);
+        size_t allocations = resource.allocations;
+        CHECK(allocations >= 2);
+
+        // copies and moves keep the resource
+        auto copy = c;
+        CHECK(copy.resource() == &resource);
+        auto moved = std::move(copy);
+        CHECK(moved.resource() == &resource);
+        CHECK(moved.get(MDB_GET_CURRENT)->second.get_allocator().resource() == &resource);
+        CHECK(resource.allocations > allocations);
+
+        counting_resource other;
+        moved.set_resource(&other);
+        auto last = moved.get(MDB_LAST);
+        CHECK(last && last->first == "std");
+        CHECK(last->second.get_allocator().resource() == &other && other.allocations > 0);
+    });
+}
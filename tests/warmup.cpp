@@ -0,0 +1,42 @@
+#include "test.hpp"
+
+#include <fstream>
+
+using namespace lmdb;
+
+int main() {
+    test::run("corrupt profile", []() {
+        test::temp_dir dir;
+        std::string path = dir.path() + "/hot-pages";
+        {
+            std::ofstream out(path, std::ios::binary);
+            uint64_t count = uint64_t(1) << 60;
+            out.write("LMDBHOT1", 8);
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        }
+        CHECK(!page_profile::load(path));
+    });
+
+    test::run("missing branch db", []() {
+        test::temp_dir dir;
+        warmup_options opts;
+        opts.branch_dbs = {"missing", ""};
+        auto e = env::factory().set_max_dbs(4).set_warmup(opts).open(dir.path(), 0644);
+        read_txn t(e.handle());
+    });
+
+    test::run("recording is opt-in", []() {
+        test::temp_dir dir;
+        std::string path = dir.path() + "/hot-pages";
+        {
+            auto e = env::factory().set_warmup(warmup_options()).open(dir.path(), 0644);
+        }
+        CHECK(!std::ifstream(path));
+        warmup_options opts;
+        opts.record_on_close = true;
+        {
+            auto e = env::factory().set_warmup(opts).open(dir.path(), 0644);
+        }
+        CHECK(page_profile::load(path));
+    });
+}
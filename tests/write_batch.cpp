@@ -0,0 +1,104 @@
+#include "test.hpp"
+#include "lmdb-wrapper/write_batch.hpp"
+
+#include <thread>
+
+using namespace lmdb;
+
+namespace {
+
+dbi create(env& e) {
+    write_txn t(e.handle());
+    dbi db = t.db().set(dbi::flags::create).open("b");
+    t.put<std::string>(db, std::string("a"), std::string("1"), 0);
+    t.put<std::string>(db, std::string("b"), std::string("2"), 0);
+    t.commit();
+    return db;
+}
+
+// commits from another thread, the batch holds a read transaction on this one
+void put_elsewhere(env& e, const dbi& db, const std::string& key, const std::string& value) {
+    std::thread writer([&]() {
+        write_txn t(e.handle());
+        t.put<std::string>(db, key, value, 0);
+        t.commit();
+    });
+    writer.join();
+}
+
+std::string stored(env& e, const dbi& db, const std::string& key) {
+    read_txn t(e.handle());
+    return t.get<std::string>(db, key, std::string());
+}
+
+}
+
+int main() {
+    test::run("read your writes", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e);
+        write_batch batch(e);
+        CHECK(batch.get<std::string>(db, std::string("a")) == "1");
+        batch.put(db, std::string("a"), std::string("10"));
+        batch.del(db, std::string("b"));
+        CHECK(batch.get<std::string>(db, std::string("a")) == "10");
+        CHECK(batch.get<std::string>(db, std::string("b"), std::string("none")) == "none");
+        CHECK(stored(e, db, "a") == "1");
+        batch.commit();
+        CHECK(stored(e, db, "a") == "10" && stored(e, db, "b").empty());
+        CHECK(batch.size() == 0);
+    });
+
+    test::run("unchanged reads after other commits", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e);
+        write_batch batch(e);
+        batch.put(db, std::string("a"), batch.get<std::string>(db, std::string("a")) + "0");
+        put_elsewhere(e, db, "b", "20");
+        put_elsewhere(e, db, "a", "1");
+        batch.commit();
+        CHECK(stored(e, db, "a") == "10" && stored(e, db, "b") == "20");
+    });
+
+    test::run("conflict", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e);
+        write_batch batch(e);
+        batch.put(db, std::string("b"), batch.get<std::string>(db, std::string("a")) + "!");
+        put_elsewhere(e, db, "a", "changed");
+        bool conflict = false;
+        try {
+            batch.commit();
+        } catch (const write_conflict&) {
+            conflict = true;
+        }
+        CHECK(conflict);
+        CHECK(stored(e, db, "b") == "2");
+
+        // the batch starts over on a new snapshot
+        CHECK(batch.size() == 0);
+        batch.put(db, std::string("b"), batch.get<std::string>(db, std::string("a")) + "!");
+        batch.commit();
+        CHECK(stored(e, db, "b") == "changed!");
+    });
+
+    test::run("scan conflict", []() {
+        test::temp_dir dir;
+        auto e = test::open_env(dir.path());
+        dbi db = create(e);
+        write_batch batch(e);
+        batch.put(db, std::string("c"), std::string("3"));
+        size_t count = 0;
+        for (auto it = batch.scan<std::string, std::string>(db); it != batch_iterator<std::string, std::string>(); ++it) {
+            ++count;
+        }
+        CHECK(count == 3);
+        put_elsewhere(e, db, "z", "26");
+        CHECK_THROWS(batch.commit());
+        CHECK(stored(e, db, "c").empty());
+    });
+    return 0;
+}
@@ -0,0 +1,399 @@
+#include "lmdb-wrapper/env.hpp"
+#include "lmdb-wrapper/trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+    Replays a trace written by lmdb::trace_recorder against an environment,
+    normally a copy of the traced one made with mdb_copy, and compares the
+    latency of every kind of operation with the recorded one.
+
+    Every traced thread is replayed by its own thread, at the recorded pace
+    scaled by speed, or as fast as possible when speed is 0. Transaction
+    begins, commits, aborts, resets and renews are issued across threads in
+    the order they started in the trace, so that readers get the same
+    snapshots and writers take turns as recorded; the operations within a
+    transaction only keep the order of their own thread, which spares them a
+    hand-off between threads that would add to their replayed latency. Puts write zero filled
+    values of the recorded size; traces with hashed keys replay on the hashes
+    as keys, which keeps the access pattern but not the data. Custom
+    comparators are not known to the trace, databases using them should only
+    be replayed read only.
+
+    usage: lmdb-wrapper-trace-replay <trace> <env> [speed] [map size MiB] [flag...]
+    flags: nosubdir nosync nometasync mapasync writemap nordahead
+*/
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using lmdb::trace_record;
+using op = lmdb::trace_recorder::op;
+
+constexpr size_t op_count = static_cast<size_t>(op::cursor_get) + 1;
+
+const char* op_names[op_count] = {
+    "dbi_open", "txn_begin", "txn_commit", "txn_abort", "txn_reset", "txn_renew", "get", "put", "del", "cursor_get"
+};
+
+struct op_stats {
+    std::vector<uint64_t> recorded_ns;
+    std::vector<uint64_t> replayed_ns;
+    size_t skipped = 0;
+    size_t mismatched = 0;
+};
+
+struct level {
+    MDB_txn *txn;
+    std::map<MDB_dbi, MDB_cursor*> cursors;
+};
+
+/**
+    Lets each transaction boundary be issued only after all the boundaries
+    that started before it.
+*/
+class sequencer {
+public:
+    static constexpr size_t unordered = ~size_t(0);
+
+    static bool ordered(op kind) {
+        switch (kind) {
+            case op::txn_begin:
+            case op::txn_commit:
+            case op::txn_abort:
+            case op::txn_reset:
+            case op::txn_renew:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void wait_turn(size_t index) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return next_ == index; });
+        ++next_;
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t next_ = 0;
+};
+
+bool needs_key(unsigned int cursor_op) {
+    switch (cursor_op) {
+        case MDB_SET:
+        case MDB_SET_KEY:
+        case MDB_SET_RANGE:
+        case MDB_GET_BOTH:
+        case MDB_GET_BOTH_RANGE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+lmdb::trace_recorder::status to_status(int err) {
+    if (!err) {
+        return lmdb::trace_recorder::status::ok;
+    }
+    return err == MDB_NOTFOUND? lmdb::trace_recorder::status::not_found : lmdb::trace_recorder::status::error;
+}
+
+void close_cursors(level& l) {
+    for (auto& [dbi, cursor] : l.cursors) {
+        mdb_cursor_close(cursor);
+    }
+    l.cursors.clear();
+}
+
+class replayer {
+public:
+    replayer(MDB_env* env, const std::map<MDB_dbi, MDB_dbi>& dbis, sequencer& seq, clock_type::time_point origin, double speed):
+        env_{env}, dbis_{dbis}, seq_{seq}, origin_{origin}, speed_{speed}, stats_(op_count) {
+
+    }
+
+    void run(const std::vector<std::pair<size_t, const trace_record*>>& records) {
+        for (const auto& [index, rec] : records) {
+            if (speed_ > 0) {
+                std::this_thread::sleep_until(origin_ + std::chrono::nanoseconds(static_cast<uint64_t>(rec->start / speed_)));
+            }
+            if (index != sequencer::unordered) {
+                seq_.wait_turn(index);
+            }
+            replay(*rec);
+        }
+        while (!stack_.empty()) {
+            close_cursors(stack_.back());
+            if (stack_.back().txn) {
+                mdb_txn_abort(stack_.back().txn);
+            }
+            stack_.pop_back();
+        }
+    }
+
+    const std::vector<op_stats>& stats() const {
+        return stats_;
+    }
+
+private:
+    void replay(const trace_record& rec) {
+        auto& s = stats_[static_cast<size_t>(rec.kind)];
+        if (rec.kind == op::dbi_open) {
+            return;
+        }
+
+        MDB_val key{0, nullptr};
+        if (rec.keys == lmdb::trace_recorder::key_mode::full) {
+            key = MDB_val{rec.key.size(), const_cast<char*>(rec.key.data())};
+        } else if (rec.keys == lmdb::trace_recorder::key_mode::hash) {
+            key = MDB_val{sizeof(rec.key_hash), const_cast<uint64_t*>(&rec.key_hash)};
+        }
+        MDB_txn *txn = stack_.empty()? nullptr : stack_.back().txn;
+        bool txn_op = rec.kind == op::txn_begin;
+        auto dbi = dbis_.find(rec.dbi);
+        if ((!txn_op && !txn) || (rec.kind >= op::get && dbi == dbis_.end())) {
+            ++s.skipped;
+            if (rec.kind == op::txn_commit || rec.kind == op::txn_abort) {
+                if (!stack_.empty()) {
+                    stack_.pop_back();
+                }
+            }
+            return;
+        }
+        if (rec.kind == op::cursor_get && needs_key(rec.flags) && rec.keys == lmdb::trace_recorder::key_mode::none) {
+            ++s.skipped;
+            return;
+        }
+
+        int err = 0;
+        auto start = clock_type::now();
+        switch (rec.kind) {
+            case op::txn_begin: {
+                bool nested = rec.flags & lmdb::trace_recorder::nested;
+                MDB_txn *result = nullptr;
+                err = mdb_txn_begin(env_, nested? txn : nullptr, rec.flags & ~lmdb::trace_recorder::nested, &result);
+                stack_.push_back(level{err? nullptr : result, {}});
+                break;
+            }
+            case op::txn_commit:
+                close_cursors(stack_.back());
+                err = mdb_txn_commit(txn);
+                stack_.pop_back();
+                break;
+            case op::txn_abort:
+                close_cursors(stack_.back());
+                mdb_txn_abort(txn);
+                stack_.pop_back();
+                break;
+            case op::txn_reset:
+                close_cursors(stack_.back());
+                mdb_txn_reset(txn);
+                break;
+            case op::txn_renew:
+                err = mdb_txn_renew(txn);
+                break;
+            case op::get: {
+                MDB_val data;
+                err = mdb_get(txn, dbi->second, &key, &data);
+                break;
+            }
+            case op::put: {
+                if (value_.size() < rec.value_size) {
+                    value_.resize(rec.value_size);
+                }
+                MDB_val data{rec.value_size, value_.data()};
+                err = mdb_put(txn, dbi->second, &key, &data, rec.flags & ~MDB_MULTIPLE);
+                break;
+            }
+            case op::del:
+                err = mdb_del(txn, dbi->second, &key, nullptr);
+                break;
+            case op::cursor_get: {
+                auto& cursors = stack_.back().cursors;
+                auto it = cursors.find(dbi->second);
+                if (it == cursors.end()) {
+                    MDB_cursor *cursor;
+                    if (mdb_cursor_open(txn, dbi->second, &cursor)) {
+                        ++s.skipped;
+                        return;
+                    }
+                    it = cursors.emplace(dbi->second, cursor).first;
+                    start = clock_type::now();
+                }
+                MDB_val data{0, nullptr};
+                err = mdb_cursor_get(it->second, &key, &data, static_cast<MDB_cursor_op>(rec.flags));
+                break;
+            }
+            default:
+                break;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - start).count();
+        s.recorded_ns.push_back(rec.duration);
+        s.replayed_ns.push_back(elapsed);
+        if (to_status(err) != rec.result) {
+            ++s.mismatched;
+        }
+    }
+
+    MDB_env *env_;
+    const std::map<MDB_dbi, MDB_dbi>& dbis_;
+    sequencer& seq_;
+    clock_type::time_point origin_;
+    double speed_;
+    std::vector<level> stack_;
+    std::vector<char> value_;
+    std::vector<op_stats> stats_;
+};
+
+double percentile_us(std::vector<uint64_t>& v, double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    size_t i = std::min(v.size() - 1, static_cast<size_t>(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i] / 1000.0;
+}
+
+std::optional<lmdb::env::flags> parse_flag(const std::string& name) {
+    static const std::map<std::string, lmdb::env::flags> names = {
+        {"nosubdir", lmdb::env::flags::nosubdir},
+        {"nosync", lmdb::env::flags::nosync},
+        {"nometasync", lmdb::env::flags::nometasync},
+        {"mapasync", lmdb::env::flags::mapasync},
+        {"writemap", lmdb::env::flags::writemap},
+        {"nordahead", lmdb::env::flags::nordahead}
+    };
+    auto it = names.find(name);
+    if (it == names.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <trace> <env> [speed] [map size MiB] [flag...]\n", argv[0]);
+        return 1;
+    }
+    double speed = argc > 3? std::atof(argv[3]) : 1.0;
+    size_t map_mib = argc > 4? std::strtoull(argv[4], nullptr, 10) : 0;
+
+    std::vector<trace_record> records;
+    std::map<MDB_dbi, std::pair<std::optional<std::string>, unsigned int>> names;
+    std::map<uint32_t, std::vector<std::pair<size_t, const trace_record*>>> threads;
+    try {
+        lmdb::trace_reader reader(argv[1]);
+        while (auto rec = reader.next()) {
+            if (rec->kind == op::dbi_open && !names.count(rec->dbi)) {
+                std::optional<std::string> name;
+                if (rec->keys != lmdb::trace_recorder::key_mode::none) {
+                    name = rec->key;
+                }
+                names.emplace(rec->dbi, std::make_pair(name, rec->flags));
+            }
+            records.push_back(std::move(*rec));
+        }
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    std::stable_sort(records.begin(), records.end(), [](const auto& a, const auto& b) {
+        return a.start < b.start;
+    });
+    size_t turns = 0;
+    for (auto& rec : records) {
+        threads[rec.thread].emplace_back(sequencer::ordered(rec.kind)? turns++ : sequencer::unordered, &rec);
+    }
+
+    lmdb::env::factory f;
+    f.set_max_dbs(static_cast<MDB_dbi>(names.size() + 1)).set_max_readers(static_cast<unsigned int>(std::max<size_t>(126, threads.size() + 8)));
+    if (map_mib) {
+        f.set_map_size(map_mib << 20);
+    }
+    for (int i = 5; i < argc; ++i) {
+        auto flag = parse_flag(argv[i]);
+        if (!flag) {
+            std::fprintf(stderr, "unknown flag %s\n", argv[i]);
+            return 1;
+        }
+        f.set(*flag);
+    }
+    lmdb::env e = f.open(argv[2], 0644);
+
+    // traced handles are mapped to the handles of the same databases here
+    std::map<MDB_dbi, MDB_dbi> dbis;
+    MDB_txn *txn;
+    if (mdb_txn_begin(e.handle(), nullptr, 0, &txn)) {
+        std::fprintf(stderr, "failed to begin transaction\n");
+        return 1;
+    }
+    for (const auto& [traced, entry] : names) {
+        MDB_dbi handle;
+        if (!mdb_dbi_open(txn, entry.first? entry.first->c_str() : nullptr, entry.second, &handle)) {
+            dbis.emplace(traced, handle);
+        } else {
+            std::fprintf(stderr, "skipping database %s\n", entry.first? entry.first->c_str() : "(main)");
+        }
+    }
+    if (mdb_txn_commit(txn)) {
+        std::fprintf(stderr, "failed to commit transaction\n");
+        return 1;
+    }
+
+    sequencer seq;
+    std::vector<std::unique_ptr<replayer>> replayers;
+    auto origin = clock_type::now();
+    for (size_t i = 0; i < threads.size(); ++i) {
+        replayers.push_back(std::make_unique<replayer>(e.handle(), dbis, seq, origin, speed));
+    }
+    std::vector<std::thread> workers;
+    size_t i = 0;
+    for (const auto& [thread, list] : threads) {
+        workers.emplace_back([&, r = replayers[i++].get()]() {
+            r->run(list);
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - origin).count();
+
+    std::printf("%zu records, %zu threads, %.3f s, %.0f ops/s\n", records.size(), threads.size(), seconds, records.size() / seconds);
+    std::printf("%-12s %10s %8s %8s %12s %12s %12s %12s %12s\n",
+        "op", "count", "skipped", "differ", "rec p50 us", "rec p99 us", "p50 us", "p99 us", "p999 us");
+    for (size_t k = 0; k < op_count; ++k) {
+        op_stats total;
+        for (const auto& r : replayers) {
+            const auto& s = r->stats()[k];
+            total.recorded_ns.insert(total.recorded_ns.end(), s.recorded_ns.begin(), s.recorded_ns.end());
+            total.replayed_ns.insert(total.replayed_ns.end(), s.replayed_ns.begin(), s.replayed_ns.end());
+            total.skipped += s.skipped;
+            total.mismatched += s.mismatched;
+        }
+        if (total.replayed_ns.empty() && !total.skipped) {
+            continue;
+        }
+        std::printf("%-12s %10zu %8zu %8zu %12.2f %12.2f %12.2f %12.2f %12.2f\n",
+            op_names[k], total.replayed_ns.size(), total.skipped, total.mismatched,
+            percentile_us(total.recorded_ns, 0.5), percentile_us(total.recorded_ns, 0.99),
+            percentile_us(total.replayed_ns, 0.5), percentile_us(total.replayed_ns, 0.99), percentile_us(total.replayed_ns, 0.999));
+    }
+    return 0;
+}